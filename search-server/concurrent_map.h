@@ -0,0 +1,93 @@
+#pragma once
+#include <algorithm>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+const size_t CACHE_LINE_SIZE = 64;
+
+// Словарь, разбитый на независимые части (шарды) со своими мьютексами.
+// Потоки, обращающиеся к разным шардам, не мешают друг другу.
+template <typename Key, typename Value>
+class ConcurrentMap {
+private:
+	// выравнивание по кэш-линии, чтобы мьютексы соседних шардов не делили одну линию
+	struct alignas(CACHE_LINE_SIZE) Bucket {
+		std::mutex mutex;
+		std::unordered_map<Key, Value> map;
+	};
+
+public:
+	static_assert(std::is_integral_v<Key>, "ConcurrentMap supports only integer keys");
+
+	// удерживает блокировку шарда, пока жив объект
+	struct Access {
+		std::lock_guard<std::mutex> guard;
+		Value& ref_to_value;
+
+		Access(const Key& key, Bucket& bucket)
+			: guard(bucket.mutex)
+			, ref_to_value(bucket.map[key]) {
+		}
+	};
+
+	explicit ConcurrentMap(size_t bucket_count)
+		: buckets_(std::max<size_t>(bucket_count, 1)) {
+	}
+
+	Access operator[](const Key& key) {
+		return { key, GetBucket(key) };
+	}
+
+	void Erase(const Key& key) {
+		Bucket& bucket = GetBucket(key);
+		std::lock_guard guard(bucket.mutex);
+		bucket.map.erase(key);
+	}
+
+	size_t GetBucketCount() const {
+		return buckets_.size();
+	}
+
+	std::map<Key, Value> BuildOrdinaryMap() {
+		std::map<Key, Value> result;
+		for (Bucket& bucket : buckets_) {
+			std::lock_guard guard(bucket.mutex);
+			result.insert(bucket.map.begin(), bucket.map.end());
+		}
+		return result;
+	}
+
+	// забирает всё содержимое в вектор, отсортированный по ключу; словарь остается пустым
+	std::vector<std::pair<Key, Value>> ExtractSorted() {
+		size_t total_size = 0;
+		for (Bucket& bucket : buckets_) {
+			std::lock_guard guard(bucket.mutex);
+			total_size += bucket.map.size();
+		}
+
+		std::vector<std::pair<Key, Value>> result;
+		result.reserve(total_size);
+		for (Bucket& bucket : buckets_) {
+			std::lock_guard guard(bucket.mutex);
+			std::move(bucket.map.begin(), bucket.map.end(), std::back_inserter(result));
+			bucket.map.clear();
+		}
+
+		std::sort(result.begin(), result.end(), [](const auto& lhs, const auto& rhs) {
+			return lhs.first < rhs.first;
+			});
+		return result;
+	}
+
+private:
+	std::vector<Bucket> buckets_;
+
+	Bucket& GetBucket(const Key& key) {
+		return buckets_[static_cast<std::make_unsigned_t<Key>>(key) % buckets_.size()];
+	}
+};
@@ -0,0 +1,43 @@
+#include "dense_accumulator.h"
+
+using namespace std;
+
+DenseAccumulator::Lease::Lease(DenseAccumulator& thread_accumulator)
+	: accumulator_(&thread_accumulator) {
+	accumulator_->in_use_ = true;
+}
+
+DenseAccumulator::Lease::Lease(unique_ptr<DenseAccumulator> owned)
+	: owned_(move(owned))
+	, accumulator_(owned_.get()) {
+}
+
+DenseAccumulator::Lease::~Lease() {
+	if (!owned_) {
+		accumulator_->in_use_ = false;
+	}
+}
+
+DenseAccumulator::Lease DenseAccumulator::Acquire(size_t document_id_bound) {
+	thread_local DenseAccumulator thread_accumulator;
+	if (!thread_accumulator.in_use_) {
+		thread_accumulator.Reset(document_id_bound);
+		return Lease(thread_accumulator);
+	}
+	auto accumulator = make_unique<DenseAccumulator>();
+	accumulator->Reset(document_id_bound);
+	return Lease(move(accumulator));
+}
+
+void DenseAccumulator::Reset(size_t document_id_bound) {
+	if (slots_.size() < document_id_bound) {
+		slots_.resize(document_id_bound);
+	}
+	++epoch_;
+	if (epoch_ == 0) { // счетчик эпох переполнился - старые метки пришлось бы принять за текущие
+		for (Slot& slot : slots_) {
+			slot.epoch = 0;
+		}
+		epoch_ = 1;
+	}
+}
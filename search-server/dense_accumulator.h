@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Плотный накопитель релевантности, индексируемый порядковым номером документа в сегменте.
+// Между запросами не очищается: слот считается занятым, только если его эпоха совпадает с текущей.
+class DenseAccumulator {
+public:
+	enum class SlotState : uint8_t {
+		ACCEPTED, // документ прошел предикат, релевантность накапливается
+		REJECTED, // документ не прошел предикат
+		EXCLUDED, // документ содержит минус-слово
+	};
+
+	// владение накопителем на время запроса
+	class Lease {
+	public:
+		explicit Lease(DenseAccumulator& thread_accumulator);
+		explicit Lease(std::unique_ptr<DenseAccumulator> owned);
+		Lease(const Lease&) = delete;
+		Lease& operator=(const Lease&) = delete;
+		~Lease();
+
+		DenseAccumulator& operator*() const {
+			return *accumulator_;
+		}
+
+		DenseAccumulator* operator->() const {
+			return accumulator_;
+		}
+
+	private:
+		std::unique_ptr<DenseAccumulator> owned_;
+		DenseAccumulator* accumulator_;
+	};
+
+	// накопитель текущего потока, если он свободен, иначе временный (при вложенных параллельных запросах);
+	// слоты [0, document_id_bound) готовы к новому запросу
+	static Lease Acquire(size_t document_id_bound);
+
+	bool IsTouched(int document_id) const {
+		return slots_[document_id].epoch == epoch_;
+	}
+
+	void Touch(int document_id, SlotState state) {
+		slots_[document_id] = { 0.0, epoch_, state };
+	}
+
+	SlotState GetState(int document_id) const {
+		return slots_[document_id].state;
+	}
+
+	double& Relevance(int document_id) {
+		return slots_[document_id].relevance;
+	}
+
+private:
+	struct Slot {
+		double relevance = 0.0;
+		uint32_t epoch = 0;
+		SlotState state = SlotState::REJECTED;
+	};
+
+	std::vector<Slot> slots_;
+	uint32_t epoch_ = 0;
+	bool in_use_ = false;
+
+	void Reset(size_t document_id_bound);
+};
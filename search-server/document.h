@@ -1,5 +1,9 @@
 #pragma once 
 #include "paginator.h" 
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
 
 struct Document {
 
@@ -19,11 +23,22 @@ struct Document {
 };
 
 
-enum class DocumentStatus {
+// один байт: в сегментах статусы хранятся плотным столбцом
+enum class DocumentStatus : uint8_t {
 	ACTUAL,
 	IRRELEVANT,
 	BANNED,
 	REMOVED,
 };
 
+const size_t DOCUMENT_STATUS_COUNT = 4;
+
+// документ для пакетного добавления; текст должен быть жив только на время вызова
+struct DocumentToAdd {
+	int id = 0;
+	std::string_view text;
+	DocumentStatus status = DocumentStatus::ACTUAL;
+	std::vector<int> ratings;
+};
+
 std::ostream& operator<<(std::ostream& output, Document document);
\ No newline at end of file
@@ -0,0 +1,110 @@
+#pragma once
+#include "document.h"
+#include "index_segment.h"
+#include <tuple>
+#include <type_traits>
+
+// Типизированные предикаты документов. Их можно передать в FindTopDocuments вместо лямбды:
+// поиск узнает их по типу и проверяет столбцы сегмента напрямую - статус по битовой карте, рейтинг по массиву, -
+// а сегменты, где подходящих документов нет, пропускает целиком. Произвольные лямбды работают как раньше.
+
+template <DocumentStatus Status>
+struct ByStatus {
+	bool operator()(int, DocumentStatus status, int) const {
+		return status == Status;
+	}
+};
+
+// статус, известный только во время выполнения
+struct StatusIs {
+	DocumentStatus status = DocumentStatus::ACTUAL;
+
+	bool operator()(int, DocumentStatus document_status, int) const {
+		return document_status == status;
+	}
+};
+
+template <int MinRating>
+struct RatingAtLeast {
+	bool operator()(int, DocumentStatus, int rating) const {
+		return rating >= MinRating;
+	}
+};
+
+// конъюнкция типизированных предикатов
+template <typename... Predicates>
+struct AllOf {
+	std::tuple<Predicates...> predicates;
+
+	AllOf() = default;
+
+	explicit AllOf(Predicates... predicates)
+		: predicates(predicates...) {
+	}
+
+	bool operator()(int document_id, DocumentStatus status, int rating) const {
+		return std::apply([&](const auto&... predicate) {
+			return (predicate(document_id, status, rating) && ...);
+			}, predicates);
+	}
+};
+
+template <typename Predicate>
+struct IsTypedDocumentPredicate : std::false_type {};
+
+template <DocumentStatus Status>
+struct IsTypedDocumentPredicate<ByStatus<Status>> : std::true_type {};
+
+template <>
+struct IsTypedDocumentPredicate<StatusIs> : std::true_type {};
+
+template <int MinRating>
+struct IsTypedDocumentPredicate<RatingAtLeast<MinRating>> : std::true_type {};
+
+template <typename... Predicates>
+struct IsTypedDocumentPredicate<AllOf<Predicates...>> : std::bool_constant<(IsTypedDocumentPredicate<Predicates>::value && ...)> {};
+
+// Сведение к столбцам сегмента. MayMatchSegment - есть ли в сегменте подходящие документы
+// (по числу документов со статусом и наибольшему рейтингу), MatchesOrdinal - проверка документа по порядковому номеру
+
+template <DocumentStatus Status>
+bool MayMatchSegment(ByStatus<Status>, const IndexSegment& segment) {
+	return segment.GetStatusCount(Status) > 0;
+}
+
+template <DocumentStatus Status>
+bool MatchesOrdinal(ByStatus<Status>, const IndexSegment& segment, int ordinal) {
+	return segment.HasStatus(ordinal, Status);
+}
+
+inline bool MayMatchSegment(StatusIs predicate, const IndexSegment& segment) {
+	return segment.GetStatusCount(predicate.status) > 0;
+}
+
+inline bool MatchesOrdinal(StatusIs predicate, const IndexSegment& segment, int ordinal) {
+	return segment.HasStatus(ordinal, predicate.status);
+}
+
+template <int MinRating>
+bool MayMatchSegment(RatingAtLeast<MinRating>, const IndexSegment& segment) {
+	return segment.GetDocumentCount() > 0 && segment.GetMaxRating() >= MinRating;
+}
+
+template <int MinRating>
+bool MatchesOrdinal(RatingAtLeast<MinRating>, const IndexSegment& segment, int ordinal) {
+	return segment.GetRating(ordinal) >= MinRating;
+}
+
+template <typename... Predicates>
+bool MayMatchSegment(const AllOf<Predicates...>& predicate, const IndexSegment& segment) {
+	return std::apply([&](const auto&... predicates) {
+		return (MayMatchSegment(predicates, segment) && ...);
+		}, predicate.predicates);
+}
+
+template <typename... Predicates>
+bool MatchesOrdinal(const AllOf<Predicates...>& predicate, const IndexSegment& segment, int ordinal) {
+	return std::apply([&](const auto&... predicates) {
+		return (MatchesOrdinal(predicates, segment, ordinal) && ...);
+		}, predicate.predicates);
+}
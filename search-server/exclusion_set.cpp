@@ -0,0 +1,67 @@
+#include "exclusion_set.h"
+#include <algorithm>
+
+using namespace std;
+
+ExclusionSet::ExclusionSet(span<const PostingList> minus_postings, size_t document_count) {
+	Assign(minus_postings, document_count);
+}
+
+void ExclusionSet::Assign(span<const PostingList> minus_postings, size_t document_count) {
+	ordinals_.clear();
+	bitmap_.clear();
+	size_t posting_count = 0;
+	for (const PostingList& postings : minus_postings) {
+		posting_count += postings.size();
+	}
+	if (posting_count == 0) {
+		return;
+	}
+
+	if (posting_count * EXCLUSION_BITMAP_RATIO >= document_count) {
+		bitmap_.assign((document_count + 63) / 64, 0);
+		for (const PostingList& postings : minus_postings) {
+			postings.ForEach([this](int ordinal, uint32_t) {
+				bitmap_[ordinal / 64] |= uint64_t{ 1 } << (ordinal % 64);
+				});
+		}
+		return;
+	}
+
+	ordinals_.reserve(posting_count);
+	for (const PostingList& postings : minus_postings) {
+		postings.ForEach([this](int ordinal, uint32_t) {
+			ordinals_.push_back(ordinal);
+			});
+	}
+	// списки уже упорядочены, сортировка нужна только для объединения нескольких
+	if (minus_postings.size() > 1) {
+		sort(ordinals_.begin(), ordinals_.end());
+		ordinals_.erase(unique(ordinals_.begin(), ordinals_.end()), ordinals_.end());
+	}
+}
+
+bool ExclusionSet::Contains(int ordinal) const {
+	if (!bitmap_.empty()) {
+		return (bitmap_[ordinal / 64] >> (ordinal % 64)) & 1;
+	}
+	return binary_search(ordinals_.begin(), ordinals_.end(), ordinal);
+}
+
+bool ExclusionSet::Cursor::Contains(int ordinal) {
+	if (!exclusions_.bitmap_.empty()) {
+		return exclusions_.Contains(ordinal);
+	}
+	const vector<int>& ordinals = exclusions_.ordinals_;
+	if (position_ < ordinals.size() && ordinals[position_] < ordinal) {
+		// шаг удваивается, пока не перешагнет ordinal, затем двоичный поиск в последнем шаге
+		size_t bound = 1;
+		while (position_ + bound < ordinals.size() && ordinals[position_ + bound] < ordinal) {
+			bound *= 2;
+		}
+		const auto first = ordinals.begin() + position_ + bound / 2;
+		const auto last = ordinals.begin() + min(position_ + bound + 1, ordinals.size());
+		position_ = lower_bound(first, last, ordinal) - ordinals.begin();
+	}
+	return position_ < ordinals.size() && ordinals[position_] == ordinal;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include "inverted_index.h"
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// битовая карта выбирается, если она не больше отсортированного массива исключенных номеров
+const size_t EXCLUSION_BITMAP_RATIO = 32;
+
+// Документы сегмента, содержащие минус-слова запроса. Строится один раз на запрос до оценки документов,
+// поэтому исключенные документы не попадают в накопитель. Небольшой набор - отсортированный массив
+// порядковых номеров, большой - битовая карта по всем документам сегмента
+class ExclusionSet {
+public:
+	ExclusionSet() = default;
+
+	ExclusionSet(std::span<const PostingList> minus_postings, size_t document_count);
+
+	// перестраивает набор для другого запроса, память прежнего набора переиспользуется
+	void Assign(std::span<const PostingList> minus_postings, size_t document_count);
+
+	bool empty() const {
+		return ordinals_.empty() && bitmap_.empty();
+	}
+
+	bool Contains(int ordinal) const;
+
+	// Проверка возрастающих номеров одного списка: в массиве поиск идет галопом от предыдущей позиции,
+	// поэтому проход по списку плюс-слова стоит O(log) на пропущенный участок, а не на каждый постинг
+	class Cursor {
+	public:
+		explicit Cursor(const ExclusionSet& exclusions)
+			: exclusions_(exclusions) {
+		}
+
+		// ordinal не меньше, чем при предыдущем вызове
+		bool Contains(int ordinal);
+
+	private:
+		const ExclusionSet& exclusions_;
+		size_t position_ = 0;
+	};
+
+private:
+	std::vector<int> ordinals_;
+	std::vector<uint64_t> bitmap_;
+};
@@ -0,0 +1,123 @@
+#include "index_segment.h"
+#include <algorithm>
+#include <bit>
+
+using namespace std;
+
+IndexSegment::IndexSegment(const SegmentColumns& columns, InvertedIndex postings)
+	: columns_(columns)
+	, postings_(move(postings)) {
+	FillSummary();
+}
+
+int IndexSegment::FindOrdinal(int document_id) const {
+	const auto it = lower_bound(columns_.document_ids.begin(), columns_.document_ids.end(), document_id);
+	if (it == columns_.document_ids.end() || *it != document_id) {
+		return NO_ORDINAL;
+	}
+	return static_cast<int>(it - columns_.document_ids.begin());
+}
+
+size_t IndexSegment::FindLocalTerm(TermId term_id) const {
+	const auto it = lower_bound(columns_.terms.begin(), columns_.terms.end(), term_id);
+	if (it == columns_.terms.end() || *it != term_id) {
+		return NO_LOCAL_TERM;
+	}
+	return it - columns_.terms.begin();
+}
+
+size_t IndexSegment::GetAllocatedBytes() const {
+	return own_document_ids_.capacity() * sizeof(int) + own_ratings_.capacity() * sizeof(int) + own_statuses_.capacity() * sizeof(DocumentStatus)
+		+ own_status_bitmaps_.capacity() * sizeof(uint64_t) + own_word_counts_.capacity() * sizeof(int)
+		+ own_inverse_word_counts_.capacity() * sizeof(double) + own_term_offsets_.capacity() * sizeof(uint64_t)
+		+ own_term_freqs_.capacity() * sizeof(TermFrequency) + own_terms_.capacity() * sizeof(TermId)
+		+ own_max_term_freqs_.capacity() * sizeof(double) + postings_.GetAllocatedBytes();
+}
+
+size_t IndexSegment::GetMappedBytes() const {
+	if (!own_document_ids_.empty()) {
+		return 0;
+	}
+	return columns_.document_ids.size_bytes() + columns_.ratings.size_bytes() + columns_.statuses.size_bytes()
+		+ columns_.status_bitmaps.size_bytes() + columns_.word_counts.size_bytes() + columns_.inverse_word_counts.size_bytes()
+		+ columns_.term_offsets.size_bytes() + columns_.term_freqs.size_bytes() + columns_.terms.size_bytes()
+		+ columns_.max_term_freqs.size_bytes();
+}
+
+void IndexSegment::FillDocuments(const vector<SegmentDocument>& documents) {
+	size_t term_count = 0;
+	for (const SegmentDocument& document : documents) {
+		term_count += document.term_freqs.size();
+	}
+	own_document_ids_.reserve(documents.size());
+	own_ratings_.reserve(documents.size());
+	own_statuses_.reserve(documents.size());
+	own_word_counts_.reserve(documents.size());
+	own_inverse_word_counts_.reserve(documents.size());
+	own_term_offsets_.reserve(documents.size() + 1);
+	own_term_freqs_.reserve(term_count);
+	own_terms_.reserve(term_count);
+
+	own_term_offsets_.push_back(0);
+	for (const SegmentDocument& document : documents) {
+		own_document_ids_.push_back(document.document_id);
+		own_ratings_.push_back(document.rating);
+		own_statuses_.push_back(document.status);
+		own_word_counts_.push_back(document.word_count);
+		own_inverse_word_counts_.push_back(document.word_count > 0 ? 1.0 / document.word_count : 0.0);
+		own_term_freqs_.insert(own_term_freqs_.end(), document.term_freqs.begin(), document.term_freqs.end());
+		own_term_offsets_.push_back(own_term_freqs_.size());
+		for (const TermFrequency& term_freq : document.term_freqs) {
+			own_terms_.push_back(term_freq.term_id);
+		}
+	}
+	sort(own_terms_.begin(), own_terms_.end());
+	own_terms_.erase(unique(own_terms_.begin(), own_terms_.end()), own_terms_.end());
+	own_terms_.shrink_to_fit();
+
+	// номера слов сегмента сохраняют порядок словаря, поэтому слова документа остаются упорядоченными
+	for (TermFrequency& term_freq : own_term_freqs_) {
+		term_freq.term_id = static_cast<TermId>(lower_bound(own_terms_.begin(), own_terms_.end(), term_freq.term_id) - own_terms_.begin());
+	}
+
+	own_status_bitmaps_.assign(DOCUMENT_STATUS_COUNT * GetStatusBitmapWords(documents.size()), 0);
+	for (size_t ordinal = 0; ordinal < own_statuses_.size(); ++ordinal) {
+		const size_t status = static_cast<size_t>(own_statuses_[ordinal]);
+		own_status_bitmaps_[status * GetStatusBitmapWords(documents.size()) + ordinal / 64] |= uint64_t{ 1 } << (ordinal % 64);
+	}
+
+	// частота считается так же, как при поиске: по числу вхождений из постинга
+	own_max_term_freqs_.assign(own_terms_.size(), 0.0);
+	for (size_t ordinal = 0; ordinal < documents.size(); ++ordinal) {
+		const size_t begin = own_term_offsets_[ordinal];
+		for (size_t i = begin; i < own_term_offsets_[ordinal + 1]; ++i) {
+			const auto [local_term, term_freq] = own_term_freqs_[i];
+			const uint32_t count = GetOccurrenceCount(term_freq, own_word_counts_[ordinal]);
+			own_max_term_freqs_[local_term] = max(own_max_term_freqs_[local_term], count * own_inverse_word_counts_[ordinal]);
+		}
+	}
+
+	columns_ = { own_document_ids_, own_ratings_, own_statuses_, own_status_bitmaps_, own_word_counts_, own_inverse_word_counts_,
+		own_term_offsets_, own_term_freqs_, own_terms_, own_max_term_freqs_ };
+	FillSummary();
+}
+
+void IndexSegment::FillSummary() {
+	status_bitmap_words_ = GetStatusBitmapWords(GetDocumentCount());
+	if (!columns_.ratings.empty()) {
+		max_rating_ = *max_element(columns_.ratings.begin(), columns_.ratings.end());
+	}
+	for (size_t status = 0; status < DOCUMENT_STATUS_COUNT; ++status) {
+		for (const uint64_t word : columns_.status_bitmaps.subspan(status * status_bitmap_words_, status_bitmap_words_)) {
+			status_counts_[status] += popcount(word);
+		}
+	}
+}
+
+vector<span<const TermFrequency>> IndexSegment::GetDocumentSpans() const {
+	vector<span<const TermFrequency>> documents(GetDocumentCount());
+	for (size_t ordinal = 0; ordinal < documents.size(); ++ordinal) {
+		documents[ordinal] = GetLocalTerms(static_cast<int>(ordinal));
+	}
+	return documents;
+}
@@ -0,0 +1,168 @@
+#pragma once
+#include "document.h"
+#include "inverted_index.h"
+#include "term_dictionary.h"
+#include <array>
+#include <cstdint>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+// документ для построения сегмента
+struct SegmentDocument {
+	int document_id = 0;
+	int rating = 0;
+	DocumentStatus status = DocumentStatus::ACTUAL;
+	std::vector<TermFrequency> term_freqs; // номера словаря по возрастанию, без повторов
+	int word_count = 0; // слов без стоп-слов; слово встречается term_freq * word_count раз
+};
+
+static_assert(sizeof(TermFrequency) == 16 && std::is_standard_layout_v<TermFrequency>, "TermFrequency is read directly from snapshots");
+
+// Столбцы сегмента по порядковым номерам документов. Принадлежат сегменту или лежат во внешней памяти (отображенном снимке)
+struct SegmentColumns {
+	std::span<const int> document_ids; // по возрастанию
+	std::span<const int> ratings;
+	std::span<const DocumentStatus> statuses;
+	std::span<const uint64_t> status_bitmaps; // DOCUMENT_STATUS_COUNT битовых карт по GetStatusBitmapWords слов подряд
+	std::span<const int> word_counts;
+	std::span<const double> inverse_word_counts;
+	std::span<const uint64_t> term_offsets; // слова документа i - term_freqs[term_offsets[i], term_offsets[i + 1])
+	std::span<const TermFrequency> term_freqs; // номера слов сегмента
+	std::span<const TermId> terms; // номера словаря по номерам слов сегмента, по возрастанию
+	std::span<const double> max_term_freqs; // по номерам слов сегмента
+};
+
+// слов в битовой карте статуса для document_count документов
+inline size_t GetStatusBitmapWords(size_t document_count) {
+	return (document_count + 63) / 64;
+}
+
+// Неизменяемая часть индекса. Документы получают порядковые номера 0..n-1 по возрастанию id;
+// постинги, рейтинги и статусы адресуются этими номерами, поэтому вместо словарей по id - плотные массивы.
+// Для каждого статуса есть еще битовая карта документов с этим статусом, чтобы фильтр по статусу был одним битом.
+// Слова сегмента тоже пронумерованы заново, по возрастанию номера в словаре:
+// маленький сегмент не платит за размер общего словаря.
+class IndexSegment {
+public:
+	static const int NO_ORDINAL = -1;
+	static const size_t NO_LOCAL_TERM = static_cast<size_t>(-1);
+
+	// documents отсортированы по id
+	template <typename ExecutionPolicy>
+	IndexSegment(ExecutionPolicy policy, const std::vector<SegmentDocument>& documents);
+
+	// сегмент снимка: столбцы и списки слов из внешней памяти без копирования; массивы проверяет вызывающий
+	IndexSegment(const SegmentColumns& columns, InvertedIndex postings);
+
+	IndexSegment(const IndexSegment&) = delete;
+	IndexSegment& operator=(const IndexSegment&) = delete;
+
+	size_t GetDocumentCount() const {
+		return columns_.document_ids.size();
+	}
+
+	int GetDocumentId(int ordinal) const {
+		return columns_.document_ids[ordinal];
+	}
+
+	int GetRating(int ordinal) const {
+		return columns_.ratings[ordinal];
+	}
+
+	// наибольший рейтинг документов сегмента, удаленных тоже; в пустом сегменте не определен
+	int GetMaxRating() const {
+		return max_rating_;
+	}
+
+	DocumentStatus GetStatus(int ordinal) const {
+		return columns_.statuses[ordinal];
+	}
+
+	bool HasStatus(int ordinal, DocumentStatus status) const {
+		return (columns_.status_bitmaps[static_cast<size_t>(status) * status_bitmap_words_ + ordinal / 64] >> (ordinal % 64)) & 1;
+	}
+
+	// число документов сегмента со статусом, удаленные тоже считаются
+	size_t GetStatusCount(DocumentStatus status) const {
+		return status_counts_[static_cast<size_t>(status)];
+	}
+
+	int GetWordCount(int ordinal) const {
+		return columns_.word_counts[ordinal];
+	}
+
+	// частота слова по числу вхождений из постинга
+	double GetTermFrequency(int ordinal, uint32_t count) const {
+		return count * columns_.inverse_word_counts[ordinal];
+	}
+
+	// NO_ORDINAL, если документа в сегменте нет
+	int FindOrdinal(int document_id) const;
+
+	// слова документа в номерах сегмента по возрастанию
+	std::span<const TermFrequency> GetLocalTerms(int ordinal) const {
+		return columns_.term_freqs.subspan(columns_.term_offsets[ordinal], columns_.term_offsets[ordinal + 1] - columns_.term_offsets[ordinal]);
+	}
+
+	size_t GetTermCount() const {
+		return columns_.terms.size();
+	}
+
+	// номер слова в словаре по номеру в сегменте
+	TermId GetTerm(size_t local_term) const {
+		return columns_.terms[local_term];
+	}
+
+	// NO_LOCAL_TERM, если слова в сегменте нет
+	size_t FindLocalTerm(TermId term_id) const;
+
+	// наибольшая частота слова в документах сегмента, верхняя оценка для отсечения при поиске
+	double GetMaxTermFrequency(size_t local_term) const {
+		return columns_.max_term_freqs[local_term];
+	}
+
+	const SegmentColumns& GetColumns() const {
+		return columns_;
+	}
+
+	const InvertedIndex& GetPostings() const {
+		return postings_;
+	}
+
+	size_t GetAllocatedBytes() const;
+
+	// столбцы, которые читаются прямо из снимка и не занимают кучу; списки слов не входят
+	size_t GetMappedBytes() const;
+
+private:
+	std::vector<int> own_document_ids_;
+	std::vector<int> own_ratings_;
+	std::vector<DocumentStatus> own_statuses_;
+	std::vector<uint64_t> own_status_bitmaps_;
+	std::vector<int> own_word_counts_;
+	std::vector<double> own_inverse_word_counts_;
+	std::vector<uint64_t> own_term_offsets_;
+	std::vector<TermFrequency> own_term_freqs_;
+	std::vector<TermId> own_terms_;
+	std::vector<double> own_max_term_freqs_;
+	SegmentColumns columns_;
+	size_t status_bitmap_words_ = 0;
+	int max_rating_ = 0;
+	std::array<size_t, DOCUMENT_STATUS_COUNT> status_counts_ = {};
+	InvertedIndex postings_;
+
+	// заполняет собственные столбцы, кроме постингов
+	void FillDocuments(const std::vector<SegmentDocument>& documents);
+
+	// размер битовых карт, наибольший рейтинг и число документов по статусам из столбцов
+	void FillSummary();
+
+	std::vector<std::span<const TermFrequency>> GetDocumentSpans() const;
+};
+
+template <typename ExecutionPolicy>
+IndexSegment::IndexSegment(ExecutionPolicy policy, const std::vector<SegmentDocument>& documents) {
+	FillDocuments(documents);
+	postings_ = InvertedIndex(policy, columns_.terms.size(), GetDocumentSpans(), columns_.word_counts);
+}
@@ -0,0 +1,190 @@
+#include "index_snapshot.h"
+#include <algorithm>
+#include <execution>
+
+using namespace std;
+
+SegmentDeletionLog::SegmentDeletionLog(const IndexSegment& segment)
+	: deletion_sequences_(make_unique<atomic<uint32_t>[]>(segment.GetDocumentCount()))
+	, term_counts_(make_unique<atomic<const CountNode*>[]>(segment.GetTermCount())) {
+}
+
+void SegmentDeletionLog::Append(const IndexSegment& segment, int ordinal) {
+	const uint32_t sequence = ++last_sequence_;
+	// узел становится виден читателям только после записи всех полей
+	for (const TermFrequency& term_freq : segment.GetLocalTerms(ordinal)) {
+		auto& head = term_counts_[term_freq.term_id];
+		const CountNode* previous = head.load(memory_order_relaxed);
+		nodes_.push_back({ sequence, (previous ? previous->count : 0) + 1, previous });
+		head.store(&nodes_.back(), memory_order_release);
+	}
+	// читатель видит новую версию после публикации снимка, а более старые версии номер sequence не учитывают
+	deletion_sequences_[ordinal].store(sequence, memory_order_relaxed);
+}
+
+size_t SegmentDeletionLog::GetDocumentFrequency(size_t local_term, uint32_t sequence) const {
+	const CountNode* node = term_counts_[local_term].load(memory_order_acquire);
+	while (node != nullptr && node->sequence > sequence) {
+		node = node->next;
+	}
+	return node != nullptr ? node->count : 0;
+}
+
+SegmentDeletions::SegmentDeletions(const SegmentDeletions* previous, const IndexSegment& segment, int ordinal) {
+	if (previous && previous->sequence_ == previous->log_->GetLastSequence()) {
+		log_ = previous->log_;
+		posting_count_ = previous->posting_count_;
+	}
+	else {
+		// журнал уже продолжен другой версией: удаления прежнего набора переписываются в новый журнал
+		log_ = make_shared<SegmentDeletionLog>(segment);
+		if (previous) {
+			for (int deleted = 0; deleted < static_cast<int>(segment.GetDocumentCount()); ++deleted) {
+				if (previous->Contains(deleted)) {
+					log_->Append(segment, deleted);
+				}
+			}
+			posting_count_ = previous->posting_count_;
+		}
+	}
+	log_->Append(segment, ordinal);
+	sequence_ = log_->GetLastSequence();
+	posting_count_ += segment.GetLocalTerms(ordinal).size();
+}
+
+double FindTermFrequency(const SegmentDocument& document, TermId term_id) {
+	const auto it = lower_bound(document.term_freqs.begin(), document.term_freqs.end(), term_id, [](const TermFrequency& term_freq, TermId id) {
+		return term_freq.term_id < id;
+		});
+	return it != document.term_freqs.end() && it->term_id == term_id ? it->term_freq : 0.0;
+}
+
+int WriteBufferState::FindOrdinal(int document_id) const {
+	// документов не больше WRITE_BUFFER_DOCUMENT_COUNT, и они не упорядочены по id
+	for (int ordinal = 0; ordinal < document_count; ++ordinal) {
+		if (!IsDeleted(ordinal) && buffer->GetDocument(ordinal).document_id == document_id) {
+			return ordinal;
+		}
+	}
+	return IndexSegment::NO_ORDINAL;
+}
+
+size_t WriteBufferState::GetDocumentFrequency(TermId term_id) const {
+	size_t document_freq = 0;
+	for (int ordinal = 0; ordinal < document_count; ++ordinal) {
+		if (!IsDeleted(ordinal) && FindTermFrequency(buffer->GetDocument(ordinal), term_id) > 0.0) {
+			++document_freq;
+		}
+	}
+	return document_freq;
+}
+
+SegmentState FreezeWriteBuffer(const WriteBufferState& state) {
+	vector<SegmentDocument> documents;
+	documents.reserve(state.GetLiveDocumentCount());
+	for (int ordinal = 0; ordinal < state.document_count; ++ordinal) {
+		if (!state.IsDeleted(ordinal)) {
+			documents.push_back(state.buffer->GetDocument(ordinal));
+		}
+	}
+	if (documents.empty()) {
+		return {};
+	}
+	sort(documents.begin(), documents.end(), [](const SegmentDocument& lhs, const SegmentDocument& rhs) {
+		return lhs.document_id < rhs.document_id;
+		});
+	return { make_shared<const IndexSegment>(execution::seq, documents), nullptr };
+}
+
+IndexSnapshot::DocumentLocation IndexSnapshot::FindDocument(int document_id) const {
+	for (size_t index = 0; index < segments.size(); ++index) {
+		const int ordinal = segments[index].segment->FindOrdinal(document_id);
+		// документ с тем же id мог быть удален из одного сегмента и добавлен в другой
+		if (ordinal != IndexSegment::NO_ORDINAL && !segments[index].IsDeleted(ordinal)) {
+			return { index, ordinal };
+		}
+	}
+	const int ordinal = write_buffer.FindOrdinal(document_id);
+	if (ordinal != IndexSegment::NO_ORDINAL) {
+		return { segments.size(), ordinal, true };
+	}
+	return {};
+}
+
+size_t IndexSnapshot::GetDocumentFrequency(TermId term_id) const {
+	size_t document_freq = write_buffer.GetDocumentFrequency(term_id);
+	for (const SegmentState& state : segments) {
+		const size_t local_term = state.segment->FindLocalTerm(term_id);
+		if (local_term != IndexSegment::NO_LOCAL_TERM) {
+			document_freq += state.GetDocumentFrequency(local_term);
+		}
+	}
+	return document_freq;
+}
+
+SegmentState MergeSegments(span<const SegmentState> states, const vector<TermId>& new_term_ids) {
+	vector<SegmentDocument> documents;
+	for (const SegmentState& state : states) {
+		const IndexSegment& segment = *state.segment;
+		for (int ordinal = 0; ordinal < static_cast<int>(segment.GetDocumentCount()); ++ordinal) {
+			if (state.IsDeleted(ordinal)) {
+				continue;
+			}
+			SegmentDocument document{ segment.GetDocumentId(ordinal), segment.GetRating(ordinal), segment.GetStatus(ordinal), {}, segment.GetWordCount(ordinal) };
+			const auto terms = segment.GetLocalTerms(ordinal);
+			document.term_freqs.reserve(terms.size());
+			for (const auto& [local_term, term_freq] : terms) {
+				const TermId term_id = segment.GetTerm(local_term);
+				document.term_freqs.push_back({ new_term_ids.empty() ? term_id : new_term_ids[term_id], term_freq });
+			}
+			documents.push_back(move(document));
+		}
+	}
+	if (documents.empty()) {
+		return {};
+	}
+	sort(documents.begin(), documents.end(), [](const SegmentDocument& lhs, const SegmentDocument& rhs) {
+		return lhs.document_id < rhs.document_id;
+		});
+	return { make_shared<const IndexSegment>(execution::par, documents), nullptr };
+}
+
+namespace {
+	size_t GetSegmentTier(const SegmentState& state) {
+		size_t tier = 0;
+		for (size_t size = state.segment->GetDocumentCount(); size >= SEGMENT_MERGE_FACTOR; size /= SEGMENT_MERGE_FACTOR) {
+			++tier;
+		}
+		return tier;
+	}
+}
+
+vector<size_t> SelectSegmentsToMerge(span<const SegmentState> segments) {
+	for (size_t index = 0; index < segments.size(); ++index) {
+		const SegmentState& state = segments[index];
+		if (state.deletions && state.deletions->size() * DELETED_DOCUMENTS_PURGE_RATIO >= state.segment->GetDocumentCount()) {
+			return { index };
+		}
+	}
+	// каждый документ переписывается не больше одного раза на ярус, то есть O(log n) раз
+	vector<vector<size_t>> tiers;
+	for (size_t index = 0; index < segments.size(); ++index) {
+		const size_t tier = GetSegmentTier(segments[index]);
+		if (tier >= tiers.size()) {
+			tiers.resize(tier + 1);
+		}
+		tiers[tier].push_back(index);
+		if (tiers[tier].size() == SEGMENT_MERGE_FACTOR) {
+			return tiers[tier];
+		}
+	}
+	return {};
+}
+
+SegmentState RemoveFromSegment(const SegmentState& state, int ordinal) {
+	SegmentState result{ state.segment, make_shared<const SegmentDeletions>(state.deletions.get(), *state.segment, ordinal) };
+	if (result.GetLiveDocumentCount() == 0) {
+		return {};
+	}
+	return result;
+}
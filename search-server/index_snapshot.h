@@ -0,0 +1,206 @@
+#pragma once
+#include "index_segment.h"
+#include "term_dictionary.h"
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+// сегменты одного яруса (одного порядка размера по основанию SEGMENT_MERGE_FACTOR) сливаются, когда их набирается столько
+const size_t SEGMENT_MERGE_FACTOR = 8;
+// сегмент переписывается без удаленных документов, когда они составляют не меньше 1/DELETED_DOCUMENTS_PURGE_RATIO его размера
+const size_t DELETED_DOCUMENTS_PURGE_RATIO = 4;
+// буфер записи замораживается в сегмент, когда в нем набирается столько документов
+const size_t WRITE_BUFFER_DOCUMENT_COUNT = 64;
+
+// Журнал удалений сегмента, общий для всех версий его набора удаленных. Удаления только добавляются и получают
+// номера 1, 2, ...; версия с номером v видит удаления с номерами не больше v. Для документа хранится номер его удаления,
+// для слова - история числа удаленных документов со словом, новые значения в начале. Поэтому удаление стоит
+// O(число слов документа), а не копию битовой карты и счетчиков. Дописывает журнал только писатель, читатели
+// других версий читают его одновременно
+class SegmentDeletionLog {
+public:
+	explicit SegmentDeletionLog(const IndexSegment& segment);
+
+	SegmentDeletionLog(const SegmentDeletionLog&) = delete;
+	SegmentDeletionLog& operator=(const SegmentDeletionLog&) = delete;
+
+	// номер последнего удаления; 0, если удалений нет
+	uint32_t GetLastSequence() const {
+		return last_sequence_;
+	}
+
+	// записывает удаление документа следующим номером
+	void Append(const IndexSegment& segment, int ordinal);
+
+	bool Contains(int ordinal, uint32_t sequence) const {
+		const uint32_t deletion = deletion_sequences_[ordinal].load(std::memory_order_relaxed);
+		return deletion != 0 && deletion <= sequence;
+	}
+
+	size_t GetDocumentFrequency(size_t local_term, uint32_t sequence) const;
+
+private:
+	struct CountNode {
+		uint32_t sequence;
+		uint32_t count;
+		const CountNode* next;
+	};
+
+	std::unique_ptr<std::atomic<uint32_t>[]> deletion_sequences_; // по номеру документа, 0 - не удален
+	std::unique_ptr<std::atomic<const CountNode*>[]> term_counts_; // по номеру слова сегмента
+	std::deque<CountNode> nodes_; // адреса узлов не меняются при добавлении
+	uint32_t last_sequence_ = 0;
+};
+
+// Удаленные документы сегмента в одной версии. Сегмент неизменяем, поэтому удаление создает новый набор
+// на основе прежнего; наборы одного сегмента делят журнал. Новые наборы создаются только под блокировкой писателя
+class SegmentDeletions {
+public:
+	// previous - прежний набор или nullptr
+	SegmentDeletions(const SegmentDeletions* previous, const IndexSegment& segment, int ordinal);
+
+	bool Contains(int ordinal) const {
+		return log_->Contains(ordinal, sequence_);
+	}
+
+	size_t size() const {
+		return sequence_;
+	}
+
+	// число удаленных документов со словом сегмента
+	size_t GetDocumentFrequency(size_t local_term) const {
+		return log_->GetDocumentFrequency(local_term, sequence_);
+	}
+
+	size_t GetPostingCount() const {
+		return posting_count_;
+	}
+
+private:
+	std::shared_ptr<SegmentDeletionLog> log_;
+	uint32_t sequence_ = 0;
+	size_t posting_count_ = 0;
+};
+
+struct SegmentState {
+	std::shared_ptr<const IndexSegment> segment;
+	std::shared_ptr<const SegmentDeletions> deletions; // nullptr, пока удалений нет
+
+	bool IsDeleted(int ordinal) const {
+		return deletions && deletions->Contains(ordinal);
+	}
+
+	size_t GetLiveDocumentCount() const {
+		return segment->GetDocumentCount() - (deletions ? deletions->size() : 0);
+	}
+
+	// число живых документов со словом сегмента
+	size_t GetDocumentFrequency(size_t local_term) const {
+		return segment->GetPostings().GetDocumentFrequency(local_term) - (deletions ? deletions->GetDocumentFrequency(local_term) : 0);
+	}
+};
+
+// Буфер записи: последние добавленные документы в порядке добавления, слова документа - номера словаря без сжатия.
+// Места под документы выделены заранее и только заполняются, поэтому версии, которые видят меньше документов,
+// читают буфер одновременно с писателем. Сегмент строится, только когда буфер заполнен
+class WriteBuffer {
+public:
+	WriteBuffer()
+		: documents_(WRITE_BUFFER_DOCUMENT_COUNT) {
+	}
+
+	WriteBuffer(const WriteBuffer&) = delete;
+	WriteBuffer& operator=(const WriteBuffer&) = delete;
+
+	const SegmentDocument& GetDocument(int ordinal) const {
+		return documents_[ordinal];
+	}
+
+	// заполняет место ordinal; вызывается только писателем для места, которое еще не опубликовано
+	void Put(int ordinal, SegmentDocument document) {
+		documents_[ordinal] = std::move(document);
+	}
+
+private:
+	std::vector<SegmentDocument> documents_;
+};
+
+// частота слова в документе; 0, если слова в документе нет
+double FindTermFrequency(const SegmentDocument& document, TermId term_id);
+
+// Буфер записи в одной версии индекса: первые document_count документов буфера без удаленных
+struct WriteBufferState {
+	static_assert(WRITE_BUFFER_DOCUMENT_COUNT <= 64, "deleted documents of the write buffer are a 64-bit mask");
+
+	std::shared_ptr<const WriteBuffer> buffer; // nullptr, пока в буфере ничего нет
+	int document_count = 0;
+	uint64_t deleted = 0; // бит на документ
+
+	bool IsDeleted(int ordinal) const {
+		return (deleted >> ordinal) & 1;
+	}
+
+	bool IsFull() const {
+		return static_cast<size_t>(document_count) == WRITE_BUFFER_DOCUMENT_COUNT;
+	}
+
+	size_t GetLiveDocumentCount() const {
+		return document_count - std::popcount(deleted);
+	}
+
+	// NO_ORDINAL, если живого документа с таким id в буфере нет
+	int FindOrdinal(int document_id) const;
+
+	// число живых документов буфера со словом
+	size_t GetDocumentFrequency(TermId term_id) const;
+};
+
+// сегмент из живых документов буфера; без живых документов - segment == nullptr
+SegmentState FreezeWriteBuffer(const WriteBufferState& state);
+
+// Версия индекса. После публикации не меняется: читатель берет shared_ptr на текущую версию и работает с ней
+// без блокировок, писатель собирает новую версию и подменяет указатель. Сегменты и словарь общие у соседних версий;
+// версия, которую никто не держит, освобождается вместе с ненужными ей сегментами
+struct IndexSnapshot {
+	IndexSnapshot() = default;
+
+	// пустая версия над словарем
+	explicit IndexSnapshot(std::shared_ptr<const TermDictionary> terms)
+		: terms(std::move(terms)) {
+	}
+
+	std::shared_ptr<const TermDictionary> terms;
+	std::vector<SegmentState> segments;
+	size_t document_count = 0;
+	double log_document_count = 0.0;
+	uint64_t generation = 0; // растет при изменении набора документов, слияния его не меняют
+	WriteBufferState write_buffer; // в сегменты не входит и фоновыми слияниями не трогается
+
+	struct DocumentLocation {
+		size_t segment_index = 0;
+		int ordinal = IndexSegment::NO_ORDINAL;
+		bool is_buffered = false; // ordinal - номер в буфере записи
+	};
+
+	// ordinal == NO_ORDINAL, если живого документа с таким id нет
+	DocumentLocation FindDocument(int document_id) const;
+
+	// число живых документов со словом во всех сегментах и в буфере
+	size_t GetDocumentFrequency(TermId term_id) const;
+};
+
+// живые документы сегментов в одном новом сегменте; new_term_ids, если не пуст, меняет номера слов.
+// Если живых документов нет, segment == nullptr
+SegmentState MergeSegments(std::span<const SegmentState> states, const std::vector<TermId>& new_term_ids = {});
+
+// номера сегментов для очередного слияния: сегмент с большой долей удаленных
+// или SEGMENT_MERGE_FACTOR сегментов одного яруса; пусто, если сливать нечего
+std::vector<size_t> SelectSegmentsToMerge(std::span<const SegmentState> segments);
+
+// состояние сегмента без документа; без живых документов - segment == nullptr
+SegmentState RemoveFromSegment(const SegmentState& state, int ordinal);
@@ -0,0 +1,390 @@
+#pragma once
+#include "posting_codec.h"
+#include "term_dictionary.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <execution>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <span>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// наименьшее число постингов на часть при параллельной сборке InvertedIndex
+const size_t INDEX_PART_MIN_POSTINGS = 1 << 14;
+
+struct TermFrequency {
+	TermId term_id = 0;
+	double term_freq = 0.0;
+};
+
+// число вхождений слова, которое хранится в постинге вместо частоты
+inline uint32_t GetOccurrenceCount(double term_freq, int word_count) {
+	return static_cast<uint32_t>(std::max(1l, std::lround(term_freq * word_count)));
+}
+
+// Сжатый список одного слова: блоки по POSTING_BLOCK_SIZE постингов (номер документа в сегменте, число вхождений)
+// по возрастанию номера документа
+class PostingList {
+public:
+	PostingList() = default;
+
+	PostingList(std::span<const PostingBlock> blocks, const uint32_t* data, size_t size)
+		: blocks_(blocks)
+		, data_(data)
+		, size_(size) {
+	}
+
+	size_t size() const {
+		return size_;
+	}
+
+	bool empty() const {
+		return size_ == 0;
+	}
+
+	// function(ordinal, count) для постингов с номерами из [ordinal_begin, ordinal_end);
+	// блоки, которые целиком раньше ordinal_begin, не распаковываются
+	template <typename Function>
+	void ForEach(int ordinal_begin, int ordinal_end, Function function) const;
+
+	template <typename Function>
+	void ForEach(Function function) const {
+		ForEach(0, INT32_MAX, function);
+	}
+
+	std::span<const PostingBlock> GetBlocks() const {
+		return blocks_;
+	}
+
+	const uint32_t* GetData() const {
+		return data_;
+	}
+
+private:
+	std::span<const PostingBlock> blocks_;
+	const uint32_t* data_ = nullptr;
+	size_t size_ = 0;
+};
+
+// Проход по сжатому списку по одному постингу с переходом вперед: блоки, которые Seek перешагивает, не распаковываются
+class PostingCursor {
+public:
+	static constexpr int END = INT32_MAX;
+
+	explicit PostingCursor(const PostingList& postings)
+		: blocks_(postings.GetBlocks())
+		, data_(postings.GetData()) {
+		LoadBlock(0);
+	}
+
+	// END, когда список закончился
+	int GetOrdinal() const {
+		return ordinal_;
+	}
+
+	uint32_t GetCount() const {
+		return counts_[position_];
+	}
+
+	void Next() {
+		if (++position_ < blocks_[block_].size) {
+			ordinal_ = static_cast<int>(documents_[position_]);
+		}
+		else {
+			LoadBlock(block_ + 1);
+		}
+	}
+
+	// к первому постингу с номером не меньше ordinal
+	void Seek(int ordinal) {
+		if (ordinal_ >= ordinal) {
+			return;
+		}
+		if (blocks_[block_].last_document < ordinal) {
+			const auto block = std::partition_point(blocks_.begin() + block_ + 1, blocks_.end(), [ordinal](const PostingBlock& block) {
+				return block.last_document < ordinal;
+				});
+			LoadBlock(block - blocks_.begin());
+			if (ordinal_ >= ordinal) {
+				return;
+			}
+		}
+		position_ = std::lower_bound(documents_ + position_, documents_ + blocks_[block_].size, static_cast<uint32_t>(ordinal)) - documents_;
+		ordinal_ = static_cast<int>(documents_[position_]);
+	}
+
+private:
+	std::span<const PostingBlock> blocks_;
+	const uint32_t* data_ = nullptr;
+	size_t block_ = 0;
+	size_t position_ = 0;
+	int ordinal_ = END;
+	uint32_t documents_[POSTING_BLOCK_SIZE];
+	uint32_t counts_[POSTING_BLOCK_SIZE];
+
+	void LoadBlock(size_t block) {
+		block_ = block;
+		position_ = 0;
+		if (block_ == blocks_.size()) {
+			ordinal_ = END;
+			return;
+		}
+		DecodePostingBlock(blocks_[block_], data_, block_ == 0 ? -1 : blocks_[block_ - 1].last_document, documents_, counts_);
+		ordinal_ = static_cast<int>(documents_[0]);
+	}
+};
+
+// Неизменяемый инвертированный индекс сегмента. Списки всех слов лежат подряд: у слова term
+// постинги с номерами [offsets[term], offsets[term + 1]) и блоки [block_offsets[term], block_offsets[term + 1]).
+// Массивы принадлежат индексу или лежат во внешней памяти (отображенном снимке), которая должна жить дольше индекса.
+class InvertedIndex {
+public:
+	InvertedIndex() = default;
+
+	// documents[i] - слова документа i с частотами, номера слов меньше term_count; word_counts[i] - число слов документа,
+	// в постинг попадает число вхождений term_freq * word_count. Документы делятся на части, каждая часть считает
+	// и раскладывает свои постинги параллельно с остальными, затем слова сжимаются тоже частями
+	template <typename ExecutionPolicy>
+	InvertedIndex(ExecutionPolicy policy, size_t term_count, const std::vector<std::span<const TermFrequency>>& documents,
+		std::span<const int> word_counts);
+
+	// Списки из внешней памяти без копирования. Смещения проверяет вызывающий, а список слова - check_list
+	// при первом Find этого слова; check_list бросает исключение, если список испорчен
+	InvertedIndex(std::span<const uint64_t> offsets, std::span<const uint64_t> block_offsets,
+		std::span<const PostingBlock> blocks, std::span<const uint32_t> data,
+		std::function<void(const InvertedIndex&, size_t term)> check_list)
+		: offsets_(offsets)
+		, block_offsets_(block_offsets)
+		, blocks_(blocks)
+		, data_(data)
+		, check_list_(std::move(check_list))
+		, checked_lists_(std::make_unique<std::atomic<bool>[]>(GetTermCount())) {
+	}
+
+	InvertedIndex(const InvertedIndex&) = delete;
+	InvertedIndex& operator=(const InvertedIndex&) = delete;
+	InvertedIndex(InvertedIndex&&) = default;
+	InvertedIndex& operator=(InvertedIndex&&) = default;
+
+	PostingList Find(size_t term) const {
+		if (checked_lists_ && !checked_lists_[term].load(std::memory_order_acquire)) {
+			CheckList(term);
+		}
+		return PostingList(blocks_.subspan(block_offsets_[term], block_offsets_[term + 1] - block_offsets_[term]),
+			data_.data(), GetDocumentFrequency(term));
+	}
+
+	size_t GetDocumentFrequency(size_t term) const {
+		return offsets_[term + 1] - offsets_[term];
+	}
+
+	size_t GetTermCount() const {
+		return offsets_.empty() ? 0 : offsets_.size() - 1;
+	}
+
+	size_t GetPostingCount() const {
+		return offsets_.empty() ? 0 : offsets_.back();
+	}
+
+	std::span<const uint64_t> GetOffsets() const {
+		return offsets_;
+	}
+
+	std::span<const uint64_t> GetBlockOffsets() const {
+		return block_offsets_;
+	}
+
+	std::span<const PostingBlock> GetBlocks() const {
+		return blocks_;
+	}
+
+	std::span<const uint32_t> GetData() const {
+		return data_;
+	}
+
+	// сжатые списки вместе со смещениями
+	size_t GetCompressedBytes() const {
+		return offsets_.size_bytes() + block_offsets_.size_bytes() + blocks_.size_bytes() + data_.size_bytes();
+	}
+
+	size_t GetAllocatedBytes() const {
+		return (own_offsets_.capacity() + own_block_offsets_.capacity()) * sizeof(uint64_t)
+			+ own_blocks_.capacity() * sizeof(PostingBlock) + own_data_.capacity() * sizeof(uint32_t);
+	}
+
+	size_t GetMappedBytes() const {
+		return own_offsets_.empty() ? blocks_.size_bytes() + data_.size_bytes() : 0;
+	}
+
+	// проверяет все еще не проверенные списки, например перед тем, как переписать их в другой файл
+	void CheckLists() const {
+		for (size_t term = 0; checked_lists_ && term < GetTermCount(); ++term) {
+			if (!checked_lists_[term].load(std::memory_order_acquire)) {
+				CheckList(term);
+			}
+		}
+	}
+
+private:
+	std::vector<uint64_t> own_offsets_;
+	std::vector<uint64_t> own_block_offsets_;
+	std::vector<PostingBlock> own_blocks_;
+	std::vector<uint32_t> own_data_;
+	std::span<const uint64_t> offsets_;
+	std::span<const uint64_t> block_offsets_;
+	std::span<const PostingBlock> blocks_;
+	std::span<const uint32_t> data_;
+	// только у списков из внешней памяти; несколько потоков могут проверить один список одновременно, это безвредно
+	std::function<void(const InvertedIndex&, size_t term)> check_list_;
+	std::unique_ptr<std::atomic<bool>[]> checked_lists_;
+
+	void CheckList(size_t term) const {
+		check_list_(*this, term);
+		checked_lists_[term].store(true, std::memory_order_release);
+	}
+};
+
+template <typename Function>
+void PostingList::ForEach(int ordinal_begin, int ordinal_end, Function function) const {
+	auto block = std::partition_point(blocks_.begin(), blocks_.end(), [ordinal_begin](const PostingBlock& block) {
+		return block.last_document < ordinal_begin;
+		});
+	uint32_t documents[POSTING_BLOCK_SIZE];
+	uint32_t counts[POSTING_BLOCK_SIZE];
+	for (; block != blocks_.end(); ++block) {
+		const int previous_document = block == blocks_.begin() ? -1 : (block - 1)->last_document;
+		if (previous_document + 1 >= ordinal_end) {
+			return;
+		}
+		DecodePostingBlock(*block, data_, previous_document, documents, counts);
+		for (size_t i = 0; i < block->size; ++i) {
+			const int ordinal = static_cast<int>(documents[i]);
+			if (ordinal >= ordinal_end) {
+				return;
+			}
+			if (ordinal >= ordinal_begin) {
+				function(ordinal, counts[i]);
+			}
+		}
+	}
+}
+
+template <typename ExecutionPolicy>
+InvertedIndex::InvertedIndex(ExecutionPolicy policy, size_t term_count, const std::vector<std::span<const TermFrequency>>& documents,
+	std::span<const int> word_counts) {
+	// Каждая часть держит счетчики на все слова сегмента. Поэтому последовательная сборка идет одной частью,
+	// а параллельная берет частей не больше, чем постингов на слово в среднем (счетчики не больше самих постингов),
+	// и дает каждой части не меньше INDEX_PART_MIN_POSTINGS постингов
+	size_t part_count = 1;
+	if constexpr (!std::is_same_v<std::decay_t<ExecutionPolicy>, std::execution::sequenced_policy>) {
+		size_t posting_count = 0;
+		for (const auto& document : documents) {
+			posting_count += document.size();
+		}
+		part_count = std::max<size_t>(1, std::min({ static_cast<size_t>(std::max(1u, std::thread::hardware_concurrency())) * 4,
+			documents.size(), posting_count / INDEX_PART_MIN_POSTINGS, term_count > 0 ? posting_count / term_count : 0 }));
+	}
+	std::vector<size_t> part_indexes(part_count);
+	std::iota(part_indexes.begin(), part_indexes.end(), 0);
+	const auto for_each_document = [&](size_t part, auto function) {
+		for (size_t i = documents.size() * part / part_count; i < documents.size() * (part + 1) / part_count; ++i) {
+			for (const TermFrequency& term_freq : documents[i]) {
+				function(static_cast<int>(i), term_freq);
+			}
+		}
+	};
+
+	// 1. каждая часть считает свои постинги по словам
+	std::vector<std::vector<uint64_t>> part_positions(part_count, std::vector<uint64_t>(term_count, 0));
+	std::for_each(policy, part_indexes.begin(), part_indexes.end(), [&](size_t part) {
+		auto& counts = part_positions[part];
+		for_each_document(part, [&counts](int, const TermFrequency& term_freq) {
+			++counts[term_freq.term_id];
+			});
+		});
+
+	// 2. внутри слова части идут по порядку, поэтому постинги слова получаются упорядоченными по документу
+	own_offsets_.resize(term_count + 1);
+	uint64_t position = 0;
+	for (size_t term = 0; term < term_count; ++term) {
+		own_offsets_[term] = position;
+		for (auto& positions : part_positions) {
+			const uint64_t count = positions[term];
+			positions[term] = position;
+			position += count;
+		}
+	}
+	own_offsets_[term_count] = position;
+
+	// 3. части раскладывают несжатые постинги по своим местам независимо
+	std::vector<uint32_t> posting_documents(position);
+	std::vector<uint32_t> posting_counts(position);
+	std::for_each(policy, part_indexes.begin(), part_indexes.end(), [&](size_t part) {
+		auto& positions = part_positions[part];
+		for_each_document(part, [&](int document, const TermFrequency& term_freq) {
+			const uint64_t i = positions[term_freq.term_id]++;
+			posting_documents[i] = static_cast<uint32_t>(document);
+			posting_counts[i] = GetOccurrenceCount(term_freq.term_freq, word_counts[document]);
+			});
+		});
+	part_positions.clear();
+
+	// 4. слова сжимаются частями с примерно равным числом постингов, затем части склеиваются
+	struct EncodedPart {
+		std::vector<uint64_t> block_counts;
+		std::vector<PostingBlock> blocks;
+		std::vector<uint32_t> data;
+	};
+	std::vector<size_t> term_bounds(part_count + 1, term_count);
+	for (size_t part = 0; part < part_count; ++part) {
+		term_bounds[part] = std::lower_bound(own_offsets_.begin(), own_offsets_.end() - 1, position * part / part_count) - own_offsets_.begin();
+	}
+	std::vector<EncodedPart> parts(part_count);
+	std::for_each(policy, part_indexes.begin(), part_indexes.end(), [&](size_t part) {
+		EncodedPart& encoded = parts[part];
+		for (size_t term = term_bounds[part]; term < term_bounds[part + 1]; ++term) {
+			int previous_document = -1;
+			size_t block_count = 0;
+			for (uint64_t i = own_offsets_[term]; i < own_offsets_[term + 1]; i += POSTING_BLOCK_SIZE) {
+				const size_t size = static_cast<size_t>(std::min<uint64_t>(POSTING_BLOCK_SIZE, own_offsets_[term + 1] - i));
+				encoded.blocks.push_back(EncodePostingBlock(&posting_documents[i], &posting_counts[i], size, previous_document, encoded.data));
+				previous_document = encoded.blocks.back().last_document;
+				++block_count;
+			}
+			encoded.block_counts.push_back(block_count);
+		}
+		});
+
+	own_block_offsets_.reserve(term_count + 1);
+	own_block_offsets_.push_back(0);
+	size_t block_total = 0;
+	size_t data_total = 0;
+	for (const EncodedPart& encoded : parts) {
+		block_total += encoded.blocks.size();
+		data_total += encoded.data.size();
+	}
+	own_blocks_.reserve(block_total);
+	own_data_.reserve(data_total);
+	for (EncodedPart& encoded : parts) {
+		for (const uint64_t block_count : encoded.block_counts) {
+			own_block_offsets_.push_back(own_block_offsets_.back() + block_count);
+		}
+		const uint32_t data_offset = static_cast<uint32_t>(own_data_.size());
+		for (PostingBlock& block : encoded.blocks) {
+			block.data_offset += data_offset;
+			own_blocks_.push_back(block);
+		}
+		own_data_.insert(own_data_.end(), encoded.data.begin(), encoded.data.end());
+		encoded = {};
+	}
+
+	offsets_ = own_offsets_;
+	block_offsets_ = own_block_offsets_;
+	blocks_ = own_blocks_;
+	data_ = own_data_;
+}
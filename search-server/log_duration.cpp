@@ -0,0 +1,196 @@
+#include "log_duration.h"
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <mutex>
+
+using namespace std;
+
+namespace {
+
+// гистограммы меток одного потока
+struct ThreadProfile {
+	// гистограмма метки создается потоком при первой записи
+	atomic<DurationHistogram*> histograms[MAX_PROFILE_LABELS] = {};
+
+	ThreadProfile();
+
+	// складывает гистограммы в сводку завершившихся потоков и освобождает их
+	~ThreadProfile();
+};
+
+// сумма гистограмм нескольких потоков
+struct HistogramTotal {
+	vector<uint64_t> counts;
+	uint64_t max = 0;
+
+	void Add(const DurationHistogram& histogram) {
+		if (counts.empty()) {
+			counts.assign(DurationHistogram::BUCKET_COUNT, 0);
+		}
+		for (size_t i = 0; i < counts.size(); ++i) {
+			counts[i] += histogram.GetCount(i);
+		}
+		max = std::max(max, histogram.GetMax());
+	}
+};
+
+class ProfileRegistry {
+public:
+	static ProfileRegistry& Instance() {
+		static ProfileRegistry registry;
+		return registry;
+	}
+
+	size_t RegisterLabel(const string& name) {
+		lock_guard guard(mutex_);
+		const auto it = find(labels_.begin(), labels_.end(), name);
+		if (it != labels_.end()) {
+			return it - labels_.begin();
+		}
+		labels_.push_back(name);
+		assert(labels_.size() <= MAX_PROFILE_LABELS && "too many LOG_DURATION labels, raise MAX_PROFILE_LABELS");
+		return labels_.size() - 1;
+	}
+
+	void AddThread(ThreadProfile* thread) {
+		lock_guard guard(mutex_);
+		threads_.push_back(thread);
+	}
+
+	void RemoveThread(ThreadProfile* thread) {
+		lock_guard guard(mutex_);
+		for (size_t label_id = 0; label_id < MAX_PROFILE_LABELS; ++label_id) {
+			if (const DurationHistogram* histogram = thread->histograms[label_id].load(memory_order_acquire)) {
+				retired_[label_id].Add(*histogram);
+			}
+		}
+		threads_.erase(find(threads_.begin(), threads_.end(), thread));
+	}
+
+	vector<DurationStats> CollectStats() {
+		lock_guard guard(mutex_);
+		vector<DurationStats> result;
+		for (size_t label_id = 0; label_id < labels_.size(); ++label_id) {
+			if (label_id >= MAX_PROFILE_LABELS) {
+				DurationStats stats;
+				stats.label = labels_[label_id];
+				stats.is_profiled = false;
+				result.push_back(move(stats));
+				continue;
+			}
+			HistogramTotal total = retired_[label_id];
+			for (const ThreadProfile* thread : threads_) {
+				if (const DurationHistogram* histogram = thread->histograms[label_id].load(memory_order_acquire)) {
+					total.Add(*histogram);
+				}
+			}
+			result.push_back(ComputeStats(labels_[label_id], total));
+		}
+		return result;
+	}
+
+private:
+	mutex mutex_;
+	vector<string> labels_;
+	vector<ThreadProfile*> threads_; // живые потоки
+	HistogramTotal retired_[MAX_PROFILE_LABELS]; // завершившиеся потоки
+
+	static DurationStats ComputeStats(const string& label, const HistogramTotal& total) {
+		const vector<uint64_t>& counts = total.counts;
+		DurationStats stats;
+		stats.label = label;
+		for (const uint64_t count : counts) {
+			stats.count += count;
+		}
+		if (stats.count == 0) {
+			return stats;
+		}
+
+		const auto percentile = [&](double fraction) {
+			const uint64_t rank = max<uint64_t>(1, static_cast<uint64_t>(ceil(fraction * stats.count)));
+			uint64_t seen = 0;
+			for (size_t i = 0; i < counts.size(); ++i) {
+				seen += counts[i];
+				if (seen >= rank) {
+					return min(DurationHistogram::GetBucketUpperBound(i), total.max);
+				}
+			}
+			return min(DurationHistogram::GetBucketUpperBound(counts.size() - 1), total.max);
+		};
+		stats.p50 = percentile(0.5);
+		stats.p99 = percentile(0.99);
+		stats.p999 = percentile(0.999);
+		stats.max = total.max;
+		return stats;
+	}
+};
+
+ThreadProfile::ThreadProfile() {
+	ProfileRegistry::Instance().AddThread(this);
+}
+
+ThreadProfile::~ThreadProfile() {
+	ProfileRegistry::Instance().RemoveThread(this);
+	for (auto& histogram : histograms) {
+		delete histogram.load();
+	}
+}
+
+}
+
+size_t DurationHistogram::GetBucketIndex(uint64_t nanoseconds) {
+	if (nanoseconds < SUB_BUCKET_COUNT) {
+		return nanoseconds;
+	}
+	const size_t exponent = bit_width(nanoseconds) - 1;
+	const size_t sub_bucket = (nanoseconds >> (exponent - SUB_BUCKET_BITS)) & (SUB_BUCKET_COUNT - 1);
+	return SUB_BUCKET_COUNT + (exponent - SUB_BUCKET_BITS) * SUB_BUCKET_COUNT + sub_bucket;
+}
+
+uint64_t DurationHistogram::GetBucketUpperBound(size_t bucket_index) {
+	if (bucket_index < SUB_BUCKET_COUNT) {
+		return bucket_index;
+	}
+	const size_t exponent = (bucket_index - SUB_BUCKET_COUNT) / SUB_BUCKET_COUNT + SUB_BUCKET_BITS;
+	const uint64_t mantissa = SUB_BUCKET_COUNT + (bucket_index - SUB_BUCKET_COUNT) % SUB_BUCKET_COUNT;
+	// для последней корзины сдвиг переполняется и дает максимальное значение uint64_t
+	return ((mantissa + 1) << (exponent - SUB_BUCKET_BITS)) - 1;
+}
+
+ProfileLabel::ProfileLabel(const string& name)
+	: id_(ProfileRegistry::Instance().RegisterLabel(name)) {
+}
+
+void LogDuration::RecordDuration(size_t label_id, uint64_t nanoseconds) {
+	if (label_id >= MAX_PROFILE_LABELS) {
+		return;
+	}
+	thread_local ThreadProfile thread_profile;
+	auto& slot = thread_profile.histograms[label_id];
+	DurationHistogram* histogram = slot.load(memory_order_relaxed);
+	if (histogram == nullptr) {
+		histogram = new DurationHistogram;
+		slot.store(histogram, memory_order_release);
+	}
+	histogram->Record(nanoseconds);
+}
+
+vector<DurationStats> GetDurationStats() {
+	return ProfileRegistry::Instance().CollectStats();
+}
+
+void PrintDurationSummary(ostream& output) {
+	for (const DurationStats& stats : GetDurationStats()) {
+		if (!stats.is_profiled) {
+			output << stats.label << ": not profiled, more than "s << MAX_PROFILE_LABELS << " labels"s << endl;
+			continue;
+		}
+		output << stats.label << ": count = "s << stats.count
+			<< ", p50 = "s << stats.p50 << " ns"s
+			<< ", p99 = "s << stats.p99 << " ns"s
+			<< ", p999 = "s << stats.p999 << " ns"s
+			<< ", max = "s << stats.max << " ns"s << endl;
+	}
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Профилирование горячих участков: LOG_DURATION("метка") замеряет время до конца области видимости
+// и записывает его в гистограмму метки. У каждого потока свои гистограммы, запись идет без блокировок.
+// Гистограммы завершившегося потока складываются в общую сводку и освобождаются.
+// При SEARCH_SERVER_DISABLE_PROFILING макрос ничего не делает.
+
+// метки сверх этого числа не профилируются: в отладочной сборке это assert, в сводке они отмечены is_profiled = false
+const size_t MAX_PROFILE_LABELS = 64;
+
+// Гистограмма длительностей в наносекундах: по 4 корзины на каждую степень двойки,
+// то есть относительная погрешность перцентилей не больше 25%
+class DurationHistogram {
+public:
+	static constexpr size_t SUB_BUCKET_BITS = 2;
+	static constexpr size_t SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+	static constexpr size_t BUCKET_COUNT = SUB_BUCKET_COUNT + (64 - SUB_BUCKET_BITS) * SUB_BUCKET_COUNT;
+
+	// пишет только поток-владелец, поэтому хватает relaxed load/store без атомарного сложения
+	void Record(uint64_t nanoseconds) {
+		auto& count = counts_[GetBucketIndex(nanoseconds)];
+		count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		if (nanoseconds > max_.load(std::memory_order_relaxed)) {
+			max_.store(nanoseconds, std::memory_order_relaxed);
+		}
+	}
+
+	uint64_t GetCount(size_t bucket_index) const {
+		return counts_[bucket_index].load(std::memory_order_relaxed);
+	}
+
+	// точная наибольшая длительность, а не граница корзины
+	uint64_t GetMax() const {
+		return max_.load(std::memory_order_relaxed);
+	}
+
+	static size_t GetBucketIndex(uint64_t nanoseconds);
+
+	// верхняя граница значений корзины
+	static uint64_t GetBucketUpperBound(size_t bucket_index);
+
+private:
+	std::atomic<uint64_t> counts_[BUCKET_COUNT] = {};
+	std::atomic<uint64_t> max_ = 0;
+};
+
+class ProfileLabel {
+public:
+	explicit ProfileLabel(const std::string& name);
+
+	size_t GetId() const {
+		return id_;
+	}
+
+private:
+	size_t id_;
+};
+
+class LogDuration {
+public:
+	using Clock = std::chrono::steady_clock;
+
+	explicit LogDuration(const ProfileLabel& label)
+		: label_id_(label.GetId()) {
+	}
+
+	LogDuration(const LogDuration&) = delete;
+	LogDuration& operator=(const LogDuration&) = delete;
+
+	~LogDuration() {
+		const auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_time_);
+		RecordDuration(label_id_, static_cast<uint64_t>(duration.count()));
+	}
+
+	static void RecordDuration(size_t label_id, uint64_t nanoseconds);
+
+private:
+	size_t label_id_;
+	const Clock::time_point start_time_ = Clock::now();
+};
+
+struct DurationStats {
+	std::string label;
+	bool is_profiled = true;
+	uint64_t count = 0;
+	uint64_t p50 = 0;
+	uint64_t p99 = 0;
+	uint64_t p999 = 0;
+	uint64_t max = 0; // точный максимум
+};
+
+// сводка по всем потокам, в том числе завершившимся; перцентили - верхние границы корзин в наносекундах, не больше max
+std::vector<DurationStats> GetDurationStats();
+
+void PrintDurationSummary(std::ostream& output);
+
+#define PROFILE_CONCAT_INTERNAL(X, Y) X##Y
+#define PROFILE_CONCAT(X, Y) PROFILE_CONCAT_INTERNAL(X, Y)
+
+#ifdef SEARCH_SERVER_DISABLE_PROFILING
+#define LOG_DURATION(label)
+#else
+#define LOG_DURATION(label) \
+	static const ProfileLabel PROFILE_CONCAT(profileLabel, __LINE__)(label); \
+	const LogDuration PROFILE_CONCAT(profileGuard, __LINE__)(PROFILE_CONCAT(profileLabel, __LINE__))
+#endif
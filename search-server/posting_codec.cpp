@@ -0,0 +1,215 @@
+#include "posting_codec.h"
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define POSTING_CODEC_SSE2
+#endif
+
+using namespace std;
+
+namespace {
+	const size_t LANE_COUNT = 4;
+
+	uint8_t GetBitWidth(uint32_t max_value) {
+		uint8_t bits = 0;
+		while (bits < 32 && (max_value >> bits) != 0) {
+			++bits;
+		}
+		return bits;
+	}
+
+	size_t GetPackedWords(size_t size, uint8_t bits) {
+		return size == POSTING_BLOCK_SIZE ? LANE_COUNT * bits : (size * bits + 31) / 32;
+	}
+
+	// значение index попадает в дорожку index % 4 на место index / 4; слово w дорожки j - data[4w + j]
+	void PackLanes(const uint32_t* values, uint8_t bits, uint32_t* data) {
+		for (size_t index = 0; index < POSTING_BLOCK_SIZE; ++index) {
+			const size_t lane = index % LANE_COUNT;
+			const size_t position = index / LANE_COUNT * bits;
+			const size_t word = position / 32;
+			const size_t offset = position % 32;
+			data[word * LANE_COUNT + lane] |= values[index] << offset;
+			if (offset + bits > 32) {
+				data[(word + 1) * LANE_COUNT + lane] |= values[index] >> (32 - offset);
+			}
+		}
+	}
+
+	void PackSequential(const uint32_t* values, size_t size, uint8_t bits, uint32_t* data) {
+		for (size_t index = 0; index < size; ++index) {
+			const size_t position = index * bits;
+			const size_t word = position / 32;
+			const size_t offset = position % 32;
+			data[word] |= values[index] << offset;
+			if (offset + bits > 32) {
+				data[word + 1] |= values[index] >> (32 - offset);
+			}
+		}
+	}
+
+	void UnpackSequential(const uint32_t* data, size_t size, uint8_t bits, uint32_t* values) {
+		const uint32_t mask = bits == 32 ? ~0u : (1u << bits) - 1;
+		for (size_t index = 0; index < size; ++index) {
+			const size_t position = index * bits;
+			const size_t word = position / 32;
+			const size_t offset = position % 32;
+			uint64_t value = data[word] >> offset;
+			if (offset + bits > 32) {
+				value |= static_cast<uint64_t>(data[word + 1]) << (32 - offset);
+			}
+			values[index] = static_cast<uint32_t>(value) & mask;
+		}
+	}
+
+#ifdef POSTING_CODEC_SSE2
+	// за шаг распаковывается по одному значению из каждой дорожки, то есть 4 соседних значения
+	void UnpackLanes(const uint32_t* data, uint8_t bits, uint32_t* values) {
+		const __m128i* input = reinterpret_cast<const __m128i*>(data);
+		const __m128i mask = _mm_set1_epi32(bits == 32 ? -1 : static_cast<int>((1u << bits) - 1));
+		__m128i current = _mm_loadu_si128(input++);
+		uint32_t offset = 0;
+		for (size_t step = 0; step < POSTING_BLOCK_SIZE / LANE_COUNT; ++step) {
+			__m128i value = _mm_srl_epi32(current, _mm_cvtsi32_si128(offset));
+			offset += bits;
+			if (offset >= 32) {
+				offset -= 32;
+				// после последнего значения следующего слова нет
+				if (step + 1 < POSTING_BLOCK_SIZE / LANE_COUNT || offset > 0) {
+					current = _mm_loadu_si128(input++);
+					if (offset > 0) {
+						value = _mm_or_si128(value, _mm_sll_epi32(current, _mm_cvtsi32_si128(bits - offset)));
+					}
+				}
+			}
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(values + step * LANE_COUNT), _mm_and_si128(value, mask));
+		}
+	}
+
+	// values[i] = previous + 1 + values[0] + 1 + ... + values[i]: префиксная сумма внутри четверки сдвигами, затем перенос
+	void RestoreDocuments(uint32_t* values, int previous_document) {
+		const __m128i ones = _mm_set1_epi32(1);
+		__m128i carry = _mm_set1_epi32(previous_document);
+		for (size_t index = 0; index < POSTING_BLOCK_SIZE; index += LANE_COUNT) {
+			__m128i value = _mm_add_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(values + index)), ones);
+			value = _mm_add_epi32(value, _mm_slli_si128(value, 4));
+			value = _mm_add_epi32(value, _mm_slli_si128(value, 8));
+			value = _mm_add_epi32(value, carry);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(values + index), value);
+			carry = _mm_shuffle_epi32(value, _MM_SHUFFLE(3, 3, 3, 3));
+		}
+	}
+
+	void RestoreCounts(uint32_t* values) {
+		const __m128i ones = _mm_set1_epi32(1);
+		for (size_t index = 0; index < POSTING_BLOCK_SIZE; index += LANE_COUNT) {
+			__m128i* position = reinterpret_cast<__m128i*>(values + index);
+			_mm_storeu_si128(position, _mm_add_epi32(_mm_loadu_si128(position), ones));
+		}
+	}
+#else
+	void UnpackLanes(const uint32_t* data, uint8_t bits, uint32_t* values) {
+		const uint32_t mask = bits == 32 ? ~0u : (1u << bits) - 1;
+		for (size_t index = 0; index < POSTING_BLOCK_SIZE; ++index) {
+			const size_t lane = index % LANE_COUNT;
+			const size_t position = index / LANE_COUNT * bits;
+			const size_t word = position / 32;
+			const size_t offset = position % 32;
+			uint64_t value = data[word * LANE_COUNT + lane] >> offset;
+			if (offset + bits > 32) {
+				value |= static_cast<uint64_t>(data[(word + 1) * LANE_COUNT + lane]) << (32 - offset);
+			}
+			values[index] = static_cast<uint32_t>(value) & mask;
+		}
+	}
+
+	void RestoreDocuments(uint32_t* values, int previous_document) {
+		uint32_t document = static_cast<uint32_t>(previous_document);
+		for (size_t index = 0; index < POSTING_BLOCK_SIZE; ++index) {
+			document += values[index] + 1;
+			values[index] = document;
+		}
+	}
+
+	void RestoreCounts(uint32_t* values) {
+		for (size_t index = 0; index < POSTING_BLOCK_SIZE; ++index) {
+			++values[index];
+		}
+	}
+#endif
+
+	void Pack(const uint32_t* values, size_t size, uint8_t bits, uint32_t* data) {
+		// нулевая ширина не занимает ни одного слова
+		if (bits == 0) {
+			return;
+		}
+		if (size == POSTING_BLOCK_SIZE) {
+			PackLanes(values, bits, data);
+		}
+		else {
+			PackSequential(values, size, bits, data);
+		}
+	}
+
+	void Unpack(const uint32_t* data, size_t size, uint8_t bits, uint32_t* values) {
+		if (bits == 0) {
+			fill(values, values + size, 0u);
+		}
+		else if (size == POSTING_BLOCK_SIZE) {
+			UnpackLanes(data, bits, values);
+		}
+		else {
+			UnpackSequential(data, size, bits, values);
+		}
+	}
+}
+
+size_t GetPostingBlockWords(const PostingBlock& block) {
+	return GetPackedWords(block.size, block.document_bits) + GetPackedWords(block.size, block.count_bits);
+}
+
+PostingBlock EncodePostingBlock(const uint32_t* documents, const uint32_t* counts, size_t size, int previous_document, vector<uint32_t>& data) {
+	uint32_t deltas[POSTING_BLOCK_SIZE];
+	uint32_t count_values[POSTING_BLOCK_SIZE];
+	uint32_t max_delta = 0;
+	uint32_t max_count = 0;
+	for (size_t index = 0; index < size; ++index) {
+		deltas[index] = documents[index] - static_cast<uint32_t>(previous_document) - 1;
+		previous_document = static_cast<int>(documents[index]);
+		count_values[index] = counts[index] - 1;
+		max_delta = max(max_delta, deltas[index]);
+		max_count = max(max_count, count_values[index]);
+	}
+
+	PostingBlock block;
+	block.last_document = previous_document;
+	block.data_offset = static_cast<uint32_t>(data.size());
+	block.document_bits = GetBitWidth(max_delta);
+	block.count_bits = GetBitWidth(max_count);
+	block.size = static_cast<uint16_t>(size);
+
+	const size_t document_words = GetPackedWords(size, block.document_bits);
+	data.resize(data.size() + GetPostingBlockWords(block), 0);
+	uint32_t* output = data.data() + block.data_offset;
+	Pack(deltas, size, block.document_bits, output);
+	Pack(count_values, size, block.count_bits, output + document_words);
+	return block;
+}
+
+void DecodePostingBlock(const PostingBlock& block, const uint32_t* data, int previous_document, uint32_t* documents, uint32_t* counts) {
+	const uint32_t* input = data + block.data_offset;
+	Unpack(input, block.size, block.document_bits, documents);
+	Unpack(input + GetPackedWords(block.size, block.document_bits), block.size, block.count_bits, counts);
+	if (block.size == POSTING_BLOCK_SIZE) {
+		RestoreDocuments(documents, previous_document);
+		RestoreCounts(counts);
+		return;
+	}
+	uint32_t document = static_cast<uint32_t>(previous_document);
+	for (size_t index = 0; index < block.size; ++index) {
+		document += documents[index] + 1;
+		documents[index] = document;
+		++counts[index];
+	}
+}
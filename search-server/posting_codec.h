@@ -0,0 +1,32 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Сжатие списков слов. Список делится на блоки по POSTING_BLOCK_SIZE постингов; в блоке хранятся
+// разности соседних номеров документов минус 1 и число вхождений слова минус 1, каждое упаковано
+// минимальным для блока числом бит. Полный блок упакован в 4 чередующиеся дорожки по 32 значения
+// (значение i - в дорожке i % 4), что позволяет распаковывать по 4 значения одной SSE-командой;
+// неполный последний блок упакован подряд
+const size_t POSTING_BLOCK_SIZE = 128;
+
+// Заголовок блока. Расположение фиксировано: массив заголовков читается прямо из снимка
+struct PostingBlock {
+	int32_t last_document = 0; // последний номер документа в блоке; по нему блоки пропускаются без распаковки
+	uint32_t data_offset = 0; // начало упакованных значений, в 32-битных словах
+	uint8_t document_bits = 0;
+	uint8_t count_bits = 0;
+	uint16_t size = 0;
+};
+
+static_assert(sizeof(PostingBlock) == 12);
+
+// размер упакованного блока в 32-битных словах
+size_t GetPostingBlockWords(const PostingBlock& block);
+
+// упаковывает size постингов (номера по возрастанию и больше previous_document, числа вхождений от 1),
+// дописывая слова в data
+PostingBlock EncodePostingBlock(const uint32_t* documents, const uint32_t* counts, size_t size, int previous_document, std::vector<uint32_t>& data);
+
+// распаковывает блок; documents и counts вмещают POSTING_BLOCK_SIZE значений
+void DecodePostingBlock(const PostingBlock& block, const uint32_t* data, int previous_document, uint32_t* documents, uint32_t* counts);
@@ -0,0 +1,68 @@
+#include "process_queries.h"
+#include <algorithm>
+#include <execution>
+
+using namespace std;
+
+JoinedDocuments::Iterator::Iterator(vector<vector<Document>>::const_iterator query_it,
+	vector<vector<Document>>::const_iterator query_end)
+	: query_it_(query_it)
+	, query_end_(query_end) {
+	SkipEmptyQueries();
+}
+
+JoinedDocuments::Iterator& JoinedDocuments::Iterator::operator++() {
+	++document_index_;
+	if (document_index_ == query_it_->size()) {
+		++query_it_;
+		document_index_ = 0;
+		SkipEmptyQueries();
+	}
+	return *this;
+}
+
+void JoinedDocuments::Iterator::SkipEmptyQueries() {
+	while (query_it_ != query_end_ && query_it_->empty()) {
+		++query_it_;
+	}
+}
+
+JoinedDocuments::JoinedDocuments(vector<vector<Document>> documents)
+	: documents_(move(documents)) {
+	for (const auto& query_documents : documents_) {
+		size_ += query_documents.size();
+	}
+}
+
+JoinedDocuments::Iterator JoinedDocuments::begin() const {
+	return Iterator(documents_.begin(), documents_.end());
+}
+
+JoinedDocuments::Iterator JoinedDocuments::end() const {
+	return Iterator(documents_.end(), documents_.end());
+}
+
+size_t JoinedDocuments::size() const {
+	return size_;
+}
+
+bool JoinedDocuments::empty() const {
+	return size_ == 0;
+}
+
+vector<vector<Document>> ProcessQueries(
+	const SearchServer& search_server,
+	const vector<string>& queries) {
+	vector<vector<Document>> documents_lists(queries.size());
+	// запросы и так идут параллельно, поэтому каждый отдельный запрос выполняется последовательно
+	transform(execution::par, queries.begin(), queries.end(), documents_lists.begin(), [&search_server](const string& query) {
+		return search_server.FindTopDocuments(execution::seq, query);
+		});
+	return documents_lists;
+}
+
+JoinedDocuments ProcessQueriesJoined(
+	const SearchServer& search_server,
+	const vector<string>& queries) {
+	return JoinedDocuments(ProcessQueries(search_server, queries));
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "search_server.h"
+#include <iterator>
+#include <string>
+#include <vector>
+
+// Результаты пакета запросов, которые обходятся как один плоский список документов.
+// Хранит векторы результатов отдельных запросов, как их вернул ProcessQueries, и итератор идет по ним по очереди.
+// Экономится только копирование в общий плоский вектор: результат каждого запроса по-прежнему отдельный вектор.
+class JoinedDocuments {
+public:
+	class Iterator {
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = Document;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const Document*;
+		using reference = const Document&;
+
+		Iterator() = default;
+
+		Iterator(std::vector<std::vector<Document>>::const_iterator query_it,
+			std::vector<std::vector<Document>>::const_iterator query_end);
+
+		reference operator*() const {
+			return (*query_it_)[document_index_];
+		}
+
+		pointer operator->() const {
+			return &**this;
+		}
+
+		Iterator& operator++();
+
+		Iterator operator++(int) {
+			Iterator old = *this;
+			++*this;
+			return old;
+		}
+
+		bool operator==(const Iterator& other) const {
+			return query_it_ == other.query_it_ && document_index_ == other.document_index_;
+		}
+
+		bool operator!=(const Iterator& other) const {
+			return !(*this == other);
+		}
+
+	private:
+		std::vector<std::vector<Document>>::const_iterator query_it_;
+		std::vector<std::vector<Document>>::const_iterator query_end_;
+		size_t document_index_ = 0;
+
+		void SkipEmptyQueries();
+	};
+
+	explicit JoinedDocuments(std::vector<std::vector<Document>> documents);
+
+	Iterator begin() const;
+
+	Iterator end() const;
+
+	size_t size() const;
+
+	bool empty() const;
+
+private:
+	std::vector<std::vector<Document>> documents_;
+	size_t size_ = 0;
+};
+
+// Обрабатывает запросы параллельно; i-й элемент результата - ответ на i-й запрос
+std::vector<std::vector<Document>> ProcessQueries(
+	const SearchServer& search_server,
+	const std::vector<std::string>& queries);
+
+JoinedDocuments ProcessQueriesJoined(
+	const SearchServer& search_server,
+	const std::vector<std::string>& queries);
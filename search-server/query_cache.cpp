@@ -0,0 +1,75 @@
+#include "query_cache.h"
+
+using namespace std;
+
+QueryCache::QueryCache(size_t capacity)
+	: capacity_(capacity) {
+	stats_.capacity = capacity;
+}
+
+optional<vector<Document>> QueryCache::Find(const Key& key, uint64_t generation) {
+	lock_guard guard(mutex_);
+	const auto it = entries_.find(key);
+	if (it == entries_.end()) {
+		++stats_.miss_count;
+		return nullopt;
+	}
+	if (it->second.generation != generation) {
+		Erase(it);
+		++stats_.stale_count;
+		++stats_.miss_count;
+		return nullopt;
+	}
+	++stats_.hit_count;
+	lru_.splice(lru_.begin(), lru_, it->second.lru_position);
+	return it->second.documents;
+}
+
+void QueryCache::Insert(const Key& key, vector<Document> documents, uint64_t generation) {
+	if (capacity_ == 0) {
+		return;
+	}
+	lock_guard guard(mutex_);
+	auto [it, inserted] = entries_.try_emplace(key);
+	Entry& entry = it->second;
+	entry.documents = move(documents);
+	entry.generation = generation;
+	if (inserted) {
+		lru_.push_front(&it->first);
+		entry.lru_position = lru_.begin();
+	}
+	else {
+		lru_.splice(lru_.begin(), lru_, entry.lru_position);
+	}
+	if (entries_.size() > capacity_) {
+		Erase(entries_.find(*lru_.back()));
+		++stats_.eviction_count;
+	}
+}
+
+QueryCacheStats QueryCache::GetStats() const {
+	lock_guard guard(mutex_);
+	QueryCacheStats stats = stats_;
+	stats.size = entries_.size();
+	return stats;
+}
+
+size_t QueryCache::KeyHash::operator()(const Key& key) const {
+	size_t hash = static_cast<size_t>(key.status) * 31 + key.top_count;
+	const auto combine = [&hash](size_t value) {
+		hash ^= value + 0x9e3779b97f4a7c15 + (hash << 6) + (hash >> 2);
+	};
+	for (const TermId term_id : key.plus_terms) {
+		combine(term_id);
+	}
+	combine(key.plus_terms.size()); // граница между плюс- и минус-словами
+	for (const TermId term_id : key.minus_terms) {
+		combine(term_id);
+	}
+	return hash;
+}
+
+void QueryCache::Erase(unordered_map<Key, Entry, KeyHash>::iterator it) {
+	lru_.erase(it->second.lru_position);
+	entries_.erase(it);
+}
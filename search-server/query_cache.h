@@ -0,0 +1,61 @@
+#pragma once
+#include "document.h"
+#include "term_dictionary.h"
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+struct QueryCacheStats {
+	size_t capacity = 0;
+	size_t size = 0;
+	size_t hit_count = 0;
+	size_t miss_count = 0;
+	size_t eviction_count = 0; // вытеснены по размеру
+	size_t stale_count = 0; // отброшены после изменения индекса
+};
+
+// LRU-кэш результатов запросов. Ключ - разобранный запрос (номера слов по возрастанию без повторов),
+// статус и число документов. Добавление или удаление документа меняет idf всех слов, поэтому запись помечается
+// поколением версии индекса, по которой посчитана: запись другого поколения считается промахом.
+// Методы потокобезопасны.
+class QueryCache {
+public:
+	struct Key {
+		std::vector<TermId> plus_terms;
+		std::vector<TermId> minus_terms;
+		DocumentStatus status = DocumentStatus::ACTUAL;
+		size_t top_count = 0;
+
+		bool operator==(const Key& other) const = default;
+	};
+
+	explicit QueryCache(size_t capacity);
+
+	std::optional<std::vector<Document>> Find(const Key& key, uint64_t generation);
+
+	void Insert(const Key& key, std::vector<Document> documents, uint64_t generation);
+
+	QueryCacheStats GetStats() const;
+
+private:
+	struct KeyHash {
+		size_t operator()(const Key& key) const;
+	};
+
+	struct Entry {
+		std::vector<Document> documents;
+		uint64_t generation = 0;
+		std::list<const Key*>::iterator lru_position;
+	};
+
+	mutable std::mutex mutex_;
+	const size_t capacity_;
+	std::unordered_map<Key, Entry, KeyHash> entries_;
+	std::list<const Key*> lru_; // от недавно использованных к давним; ключи лежат в узлах entries_
+	QueryCacheStats stats_;
+
+	void Erase(std::unordered_map<Key, Entry, KeyHash>::iterator it);
+};
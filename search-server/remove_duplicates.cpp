@@ -1,29 +1,265 @@
 #include "remove_duplicates.h"
-#include<iostream>
+#include <array>
+#include <iostream>
 
-void RemoveDuplicates(SearchServer& search_server) {
-	std::set<std::set<std::string>>  helper;
-	std::set<int> duplicates;
+namespace {
+
+const uint64_t GOLDEN_RATIO = 0x9e3779b97f4a7c15;
+const size_t MINHASH_SIZE = MINHASH_BAND_COUNT * MINHASH_ROWS_PER_BAND;
+
+uint64_t Mix(uint64_t value) {
+	value ^= value >> 33;
+	value *= 0xff51afd7ed558ccd;
+	value ^= value >> 33;
+	value *= 0xc4ceb9fe1a85ec53;
+	value ^= value >> 33;
+	return value;
+}
+
+uint64_t MixFingerprint(uint64_t fingerprint, uint64_t value) {
+	return Mix(fingerprint ^ (value + GOLDEN_RATIO + (fingerprint << 6) + (fingerprint >> 2)));
+}
+
+// номера слов идут по возрастанию, поэтому равные наборы дают равные отпечатки
+uint64_t ComputeFingerprint(const std::vector<TermFrequency>& terms) {
+	uint64_t fingerprint = terms.size();
+	for (const TermFrequency& term : terms) {
+		fingerprint = MixFingerprint(fingerprint, term.term_id);
+	}
+	return fingerprint;
+}
+
+// слова идут по алфавиту
+uint64_t ComputeFingerprint(const std::map<std::string_view, double>& word_freqs) {
+	uint64_t fingerprint = word_freqs.size();
+	for (const auto& [word, term_freq] : word_freqs) {
+		fingerprint = MixFingerprint(fingerprint, std::hash<std::string_view>{}(word));
+	}
+	return fingerprint;
+}
+
+bool HaveSameTerms(const std::vector<TermFrequency>& lhs, const std::vector<TermFrequency>& rhs) {
+	return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const TermFrequency& lhs_term, const TermFrequency& rhs_term) {
+		return lhs_term.term_id == rhs_term.term_id;
+		});
+}
+
+bool HaveSameWords(const std::map<std::string_view, double>& lhs, const std::map<std::string_view, double>& rhs) {
+	return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const auto& lhs_word, const auto& rhs_word) {
+		return lhs_word.first == rhs_word.first;
+		});
+}
 
-	for (auto it_f = search_server.begin(); it_f != search_server.end(); ++it_f) {
-		std::set<std::string> help_vector;
-		for (const auto& word : search_server.GetWordFrequencies(*it_f)) {
+// наборы номеров слов по возрастанию; у двух пустых наборов сходство 1, как у точных дубликатов
+double ComputeJaccard(const std::vector<TermId>& lhs, const std::vector<TermId>& rhs) {
+	if (lhs.empty() && rhs.empty()) {
+		return 1.0;
+	}
+	size_t intersection = 0;
+	for (auto lhs_it = lhs.begin(), rhs_it = rhs.begin(); lhs_it != lhs.end() && rhs_it != rhs.end();) {
+		if (*lhs_it < *rhs_it) {
+			++lhs_it;
+		}
+		else if (*rhs_it < *lhs_it) {
+			++rhs_it;
+		}
+		else {
+			++intersection;
+			++lhs_it;
+			++rhs_it;
+		}
+	}
+	return static_cast<double>(intersection) / static_cast<double>(lhs.size() + rhs.size() - intersection);
+}
 
-			help_vector.insert(word.first);
+// i-е значение подписи - минимум i-й хеш-функции по словам документа
+std::array<uint64_t, MINHASH_SIZE> ComputeMinHash(const std::vector<TermId>& terms) {
+	std::array<uint64_t, MINHASH_SIZE> signature;
+	signature.fill(std::numeric_limits<uint64_t>::max());
+	for (const TermId term_id : terms) {
+		const uint64_t term_hash = Mix(term_id + GOLDEN_RATIO);
+		for (size_t i = 0; i < MINHASH_SIZE; ++i) {
+			signature[i] = std::min(signature[i], Mix(term_hash + (i + 1) * GOLDEN_RATIO));
 		}
-		if (std::count(helper.begin(), helper.end(), help_vector)) {
-			duplicates.insert(*it_f);
+	}
+	return signature;
+}
+
+class DisjointSets {
+public:
+	explicit DisjointSets(size_t size)
+		: parents_(size) {
+		std::iota(parents_.begin(), parents_.end(), 0);
+	}
+
+	size_t Find(size_t element) {
+		while (parents_[element] != element) {
+			parents_[element] = parents_[parents_[element]];
+			element = parents_[element];
+		}
+		return element;
+	}
+
+	void Unite(size_t lhs, size_t rhs) {
+		lhs = Find(lhs);
+		rhs = Find(rhs);
+		// корень - меньший номер, то есть меньший id
+		if (lhs != rhs) {
+			parents_[std::max(lhs, rhs)] = std::min(lhs, rhs);
 		}
-		else helper.insert(help_vector);
+	}
+
+private:
+	std::vector<size_t> parents_;
+};
+
+}
 
+void RemoveDuplicates(SearchServer& search_server) {
+	const std::vector<int> document_ids(search_server.begin(), search_server.end());
+	std::vector<uint64_t> fingerprints(document_ids.size());
+	std::transform(std::execution::par, document_ids.begin(), document_ids.end(), fingerprints.begin(), [&search_server](int document_id) {
+		return ComputeFingerprint(search_server.GetDocumentTerms(document_id));
+		});
+
+	// внутри группы с одним отпечатком документы идут по возрастанию id, так что оригинал - первый из равных
+	std::vector<size_t> order(document_ids.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(std::execution::par, order.begin(), order.end(), [&fingerprints](size_t lhs, size_t rhs) {
+		return std::pair(fingerprints[lhs], lhs) < std::pair(fingerprints[rhs], rhs);
+		});
 
+	std::vector<int> duplicates;
+	for (size_t begin = 0; begin < order.size();) {
+		size_t end = begin + 1;
+		while (end < order.size() && fingerprints[order[end]] == fingerprints[order[begin]]) {
+			++end;
+		}
+		if (end - begin > 1) {
+			// одинаковый отпечаток могут дать и разные наборы
+			std::vector<std::vector<TermFrequency>> originals;
+			for (size_t i = begin; i < end; ++i) {
+				const int document_id = document_ids[order[i]];
+				auto terms = search_server.GetDocumentTerms(document_id);
+				if (std::any_of(originals.begin(), originals.end(), [&terms](const auto& original) { return HaveSameTerms(original, terms); })) {
+					duplicates.push_back(document_id);
+				}
+				else {
+					originals.push_back(std::move(terms));
+				}
+			}
+		}
+		begin = end;
 	}
 
-	for (const int& document_id : duplicates)
-	{
+	std::sort(duplicates.begin(), duplicates.end());
+	for (const int document_id : duplicates) {
 		std::cout << "Found duplicate document id " << document_id << '\n';
 		search_server.RemoveDocument(document_id);
 	}
 }
 
+std::optional<int> DuplicateDetector::AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings) {
+	server_.AddDocument(document_id, document, status, ratings);
+	const auto word_freqs = server_.GetWordFrequencies(document_id);
+	auto& candidates = fingerprint_to_documents_[ComputeFingerprint(word_freqs)];
+
+	std::optional<int> original;
+	auto candidate = candidates.begin();
+	while (candidate != candidates.end()) {
+		// удаленные документы выбрасываются; id мог быть добавлен заново с другим текстом, поэтому наборы сравниваются всегда
+		if (!std::binary_search(server_.begin(), server_.end(), *candidate)) {
+			candidate = candidates.erase(candidate);
+			continue;
+		}
+		if (HaveSameWords(server_.GetWordFrequencies(*candidate), word_freqs)) {
+			original = *candidate;
+			break;
+		}
+		++candidate;
+	}
+	candidates.push_back(document_id);
+	return original;
+}
+
+std::vector<std::vector<int>> FindNearDuplicates(const SearchServer& search_server, double jaccard_threshold) {
+	if (!(jaccard_threshold >= 0.0 && jaccard_threshold <= 1.0)) {
+		throw std::invalid_argument("Jaccard threshold must be in [0, 1]");
+	}
+
+	// номер документа здесь - позиция в document_ids, то есть порядок по возрастанию id
+	const std::vector<int> document_ids(search_server.begin(), search_server.end());
+	const size_t document_count = document_ids.size();
+	std::vector<std::vector<TermId>> term_sets(document_count);
+	std::vector<std::array<uint64_t, MINHASH_SIZE>> signatures(document_count);
+	std::vector<uint32_t> documents(document_count);
+	std::iota(documents.begin(), documents.end(), 0);
+	std::for_each(std::execution::par, documents.begin(), documents.end(), [&](uint32_t document) {
+		const auto terms = search_server.GetDocumentTerms(document_ids[document]);
+		term_sets[document].reserve(terms.size());
+		for (const TermFrequency& term : terms) {
+			term_sets[document].push_back(term.term_id);
+		}
+		signatures[document] = ComputeMinHash(term_sets[document]);
+		});
+
+	// в каждой полосе документы сортируются по хешу полосы; документ корзины с равным хешем становится кандидатом
+	// в пару только к первому документу корзины, поэтому корзина из g документов дает g - 1 кандидатов, а не g * (g - 1) / 2
+	std::vector<std::vector<std::pair<uint32_t, uint32_t>>> band_candidates(MINHASH_BAND_COUNT);
+	std::vector<size_t> bands(MINHASH_BAND_COUNT);
+	std::iota(bands.begin(), bands.end(), 0);
+	std::for_each(std::execution::par, bands.begin(), bands.end(), [&](size_t band) {
+		std::vector<std::pair<uint64_t, uint32_t>> band_hashes(document_count);
+		for (uint32_t document = 0; document < document_count; ++document) {
+			uint64_t band_hash = band;
+			for (size_t row = 0; row < MINHASH_ROWS_PER_BAND; ++row) {
+				band_hash = MixFingerprint(band_hash, signatures[document][band * MINHASH_ROWS_PER_BAND + row]);
+			}
+			band_hashes[document] = { band_hash, document };
+		}
+		std::sort(band_hashes.begin(), band_hashes.end());
+		for (size_t begin = 0; begin < band_hashes.size();) {
+			size_t end = begin + 1;
+			for (; end < band_hashes.size() && band_hashes[end].first == band_hashes[begin].first; ++end) {
+				band_candidates[band].push_back({ band_hashes[begin].second, band_hashes[end].second });
+			}
+			begin = end;
+		}
+		});
+
+	std::vector<std::pair<uint32_t, uint32_t>> candidates;
+	for (const auto& pairs : band_candidates) {
+		candidates.insert(candidates.end(), pairs.begin(), pairs.end());
+	}
+	std::sort(std::execution::par, candidates.begin(), candidates.end());
+	candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+	std::vector<char> is_near(candidates.size());
+	std::transform(std::execution::par, candidates.begin(), candidates.end(), is_near.begin(), [&term_sets, jaccard_threshold](const auto& candidate) {
+		return ComputeJaccard(term_sets[candidate.first], term_sets[candidate.second]) >= jaccard_threshold;
+		});
 
+	DisjointSets components(document_count);
+	for (size_t i = 0; i < candidates.size(); ++i) {
+		if (is_near[i]) {
+			components.Unite(candidates[i].first, candidates[i].second);
+		}
+	}
+
+	// корень компоненты - ее документ с меньшим id, он идет в группе первым
+	std::vector<std::vector<int>> clusters;
+	std::vector<size_t> root_to_cluster(document_count, document_count);
+	for (size_t document = 0; document < document_count; ++document) {
+		const size_t root = components.Find(document);
+		if (root == document) {
+			continue;
+		}
+		if (root_to_cluster[root] == document_count) {
+			root_to_cluster[root] = clusters.size();
+			clusters.push_back({ document_ids[root] });
+		}
+		clusters[root_to_cluster[root]].push_back(document_ids[document]);
+	}
+	std::sort(clusters.begin(), clusters.end());
+	return clusters;
+}
@@ -1,4 +1,41 @@
 #pragma once
 #include "search_server.h"
+#include <optional>
+#include <unordered_map>
 
-void RemoveDuplicates(SearchServer&);
\ No newline at end of file
+// MinHash-подпись документа - MINHASH_BAND_COUNT полос по MINHASH_ROWS_PER_BAND значений. Пара документов
+// становится кандидатом в почти-дубликаты, если у них совпала хотя бы одна полоса; для пары со сходством s
+// это случается с вероятностью 1 - (1 - s^r)^b: при s = 0.5 около 0.87, при s >= 0.7 больше 0.999
+const size_t MINHASH_BAND_COUNT = 32;
+const size_t MINHASH_ROWS_PER_BAND = 4;
+
+// Удаляет документы, набор слов которых совпадает с набором документа с меньшим id.
+// Отпечатки наборов считаются параллельно, документы группируются по отпечатку,
+// а совпавшие отпечатки подтверждаются сравнением самих наборов
+void RemoveDuplicates(SearchServer&);
+
+// Группы почти-дубликатов: документы связаны, если коэффициент Жаккара их наборов слов не меньше jaccard_threshold,
+// группа - связная компонента. Подписи считаются параллельно, кандидаты из совпавших полос проверяются точным
+// сравнением наборов, так что лишних пар нет, а пропуски возможны при низком пороге (см. MINHASH_BAND_COUNT).
+// Документ корзины полосы сравнивается только с ее первым документом, поэтому кандидатов не больше
+// MINHASH_BAND_COUNT на документ даже для больших групп; два документа, похожие друг на друга, но не на первые
+// документы общих корзин, попадают в одну группу, только если их связывает другая цепочка.
+// id в группе по возрастанию, группы по первому id; документы без пары в результат не входят
+std::vector<std::vector<int>> FindNearDuplicates(const SearchServer& search_server, double jaccard_threshold);
+
+// Поиск дубликатов по мере добавления: документ, добавленный через детектор, сравнивается с добавленными
+// через него раньше и еще не удаленными. Отпечаток считается по тексту слов, поэтому CompactIndex,
+// который перенумеровывает слова, ему не мешает. Детектор используется там же, где вызываются изменения сервера
+class DuplicateDetector {
+public:
+	explicit DuplicateDetector(SearchServer& search_server)
+		: server_(search_server) {
+	}
+
+	// добавляет документ в сервер; если в нем уже есть документ с тем же набором слов, возвращает его id
+	std::optional<int> AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+
+private:
+	SearchServer& server_;
+	std::unordered_map<uint64_t, std::vector<int>> fingerprint_to_documents_; // id в порядке добавления
+};
@@ -1,16 +1,74 @@
 ﻿#include "process_queries.h"
 #include "search_server.h"
+#include "remove_duplicates.h"
+#include "snapshot.h"
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <vector>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <random>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 using namespace std;
 
+#ifdef SEARCH_SERVER_COUNT_ALLOCATIONS
+// Тестовая сборка с -DSEARCH_SERVER_COUNT_ALLOCATIONS подменяет глобальные operator new/delete и считает
+// выделения памяти текущего потока, для проверки запросов без выделений. Обычная сборка их не подменяет
+thread_local size_t allocation_count = 0;
+
+// не встраиваются, иначе компилятор видит free для памяти из operator new и предупреждает о несоответствии
+[[gnu::noinline]] void* operator new(size_t size) {
+	++allocation_count;
+	if (void* pointer = malloc(size == 0 ? 1 : size)) {
+		return pointer;
+	}
+	throw bad_alloc();
+}
+
+// временные буферы stable_sort и inplace_merge берутся через nothrow и освобождаются обычным delete
+[[gnu::noinline]] void* operator new(size_t size, const nothrow_t&) noexcept {
+	++allocation_count;
+	return malloc(size == 0 ? 1 : size);
+}
+
+[[gnu::noinline]] void operator delete(void* pointer) noexcept {
+	free(pointer);
+}
+
+[[gnu::noinline]] void operator delete(void* pointer, size_t) noexcept {
+	free(pointer);
+}
+#endif
+
+// целые числа, для которых есть std::cmp_equal: bool и символьные типы сравниваются обычным ==
+template <typename T>
+constexpr bool IS_COMPARABLE_INTEGER = is_integral_v<T> && !is_same_v<T, bool> && !is_same_v<T, char>
+	&& !is_same_v<T, wchar_t> && !is_same_v<T, char8_t> && !is_same_v<T, char16_t> && !is_same_v<T, char32_t>;
+
+// size() и литерал int сравниваются по значению, без -Wsign-compare и без подмены отрицательного числа большим беззнаковым
+template <typename T, typename U>
+bool AreEqual(const T& t, const U& u) {
+	if constexpr (IS_COMPARABLE_INTEGER<T> && IS_COMPARABLE_INTEGER<U>) {
+		return cmp_equal(t, u);
+	}
+	else {
+		return t == u;
+	}
+}
+
 template <typename T, typename U>
 void AssertEqualImpl(const T& t, const U& u, const string& t_str, const string& u_str, const string& file,
 	const string& func, unsigned line, const string& hint) {
-	if (t != u) {
+	if (!AreEqual(t, u)) {
 		cout << boolalpha;
 
 		cout << file << "("s << line << "): "s << func << ": "s;
@@ -442,6 +500,921 @@ void FilterResultPlusPredicat() { // фильтр резултатов поис
 	ASSERT_EQUAL(document_second_test.size(), 4);
 }
 
+void TestTopDocumentCount() { // количество возвращаемых документов задается при вызове
+	SearchServer server;
+	for (int id = 0; id < 10; ++id) {
+		server.AddDocument(id, "кошка бежит домой"s, DocumentStatus::ACTUAL, { id });
+	}
+	ASSERT_EQUAL(server.FindTopDocuments("кошка"s).size(), MAX_RESULT_DOCUMENT_COUNT);
+	ASSERT_EQUAL(server.FindTopDocuments("кошка"s, DocumentStatus::ACTUAL, 3).size(), 3);
+	ASSERT_EQUAL(server.FindTopDocuments("кошка"s, DocumentStatus::ACTUAL, 20).size(), 10);
+	const auto seq_top = server.FindTopDocuments(execution::seq, "кошка"s, DocumentStatus::ACTUAL, 7);
+	const auto par_top = server.FindTopDocuments(execution::par, "кошка"s, DocumentStatus::ACTUAL, 7);
+	ASSERT_EQUAL(seq_top.size(), 7);
+	ASSERT_EQUAL(par_top.size(), 7);
+	for (size_t i = 0; i < seq_top.size(); ++i) {
+		ASSERT_EQUAL(seq_top[i].id, par_top[i].id);
+		ASSERT_EQUAL(seq_top[i].id, 9 - static_cast<int>(i)); // при равной релевантности - по убыванию рейтинга
+	}
+}
+
+#ifdef SEARCH_SERVER_BENCHMARKS
+// Замеры печатают время в cerr и ничего не проверяют; собираются только с -DSEARCH_SERVER_BENCHMARKS,
+// чтобы обычный прогон тестов был тихим
+void BenchmarkConcurrentMapBuckets() { // сравнение числа шардов ConcurrentMap на нагрузке параллельного запроса
+	mt19937 generator(42);
+	const int document_count = 100000;
+	vector<vector<int>> postings(32); // списки документов для 32 слов запроса
+	for (vector<int>& document_ids : postings) {
+		document_ids.resize(20000);
+		for (int& document_id : document_ids) {
+			document_id = uniform_int_distribution<int>(0, document_count - 1)(generator);
+		}
+		sort(document_ids.begin(), document_ids.end());
+	}
+
+	for (const size_t bucket_count : { 1, 8, 32, 128, 512 }) {
+		const auto start_time = chrono::steady_clock::now();
+		ConcurrentMap<int, double> document_to_relevance(bucket_count);
+		for_each(execution::par, postings.begin(), postings.end(), [&](const vector<int>& document_ids) {
+			for (const int document_id : document_ids) {
+				document_to_relevance[document_id].ref_to_value += 0.5;
+			}
+			});
+		const auto result = document_to_relevance.ExtractSorted();
+		const auto duration = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start_time);
+		cerr << "ConcurrentMap buckets = "s << bucket_count << ": "s << duration.count() << " us, documents = "s << result.size() << endl;
+	}
+}
+#endif
+
+void TestProcessQueries() { // пакетная обработка запросов
+	SearchServer server("and with"s);
+	int id = 0;
+	for (const string& text : { "funny pet and nasty rat"s, "funny pet with curly hair"s, "nasty rat with curly hair"s, "big dog"s }) {
+		server.AddDocument(++id, text, DocumentStatus::ACTUAL, { 1, 2 });
+	}
+	const vector<string> queries = { "nasty rat -not"s, "not very funny nasty pet"s, "curly hair"s, "cat"s };
+
+	const auto documents_lists = ProcessQueries(server, queries);
+	ASSERT_EQUAL(documents_lists.size(), queries.size());
+	for (size_t i = 0; i < queries.size(); ++i) {
+		const auto expected = server.FindTopDocuments(queries[i]);
+		ASSERT_EQUAL(documents_lists[i].size(), expected.size());
+		for (size_t j = 0; j < expected.size(); ++j) {
+			ASSERT_EQUAL(documents_lists[i][j].id, expected[j].id);
+		}
+	}
+
+	const auto joined = ProcessQueriesJoined(server, queries);
+	vector<int> joined_ids;
+	for (const Document& document : joined) {
+		joined_ids.push_back(document.id);
+	}
+	vector<int> expected_ids;
+	for (const auto& documents : documents_lists) {
+		for (const Document& document : documents) {
+			expected_ids.push_back(document.id);
+		}
+	}
+	ASSERT_EQUAL(joined.size(), expected_ids.size());
+	ASSERT(joined_ids == expected_ids);
+}
+
+void TestRemoveDocumentAndCompact() { // удаление документов и уплотнение индекса
+	SearchServer server;
+	server.AddDocument(1, "кошка бежит домой"s, DocumentStatus::ACTUAL, { 1 });
+	server.AddDocument(2, "собака бежит домой"s, DocumentStatus::ACTUAL, { 2 });
+	server.AddDocument(3, "попугай летит"s, DocumentStatus::ACTUAL, { 3 });
+
+	server.RemoveDocument(3);
+	server.RemoveDocument(42); // неизвестный id игнорируется
+	ASSERT_EQUAL(server.GetDocumentCount(), 2);
+	try {
+		server.GetWordFrequencies(3);
+		ASSERT_HINT(false, "removed document must not have word frequencies"s);
+	}
+	catch (const out_of_range&) {
+	}
+	ASSERT(server.FindTopDocuments("попугай"s).empty());
+
+	// idf считается только по оставшимся документам
+	const auto found = server.FindTopDocuments("кошка"s);
+	ASSERT_EQUAL(found.size(), 1);
+	ASSERT(abs(found[0].relevance - log(2.0) / 3) < MAX_RELEVANCE_DIFFERENCE);
+
+	auto stats = server.GetMemoryStats();
+	ASSERT_EQUAL(stats.term_count, 6);
+	ASSERT_EQUAL(stats.empty_term_count, 2);
+	ASSERT(stats.reclaimable_dictionary_bytes > 0);
+
+	server.AddDocument(3, "попугай спит"s, DocumentStatus::ACTUAL, { 3 });
+	ASSERT_EQUAL(server.FindTopDocuments("попугай"s).size(), 1);
+	ASSERT(server.FindTopDocuments("летит"s).empty());
+
+	server.CompactIndex();
+	stats = server.GetMemoryStats();
+	ASSERT_EQUAL(stats.term_count, 6); // "летит" больше не встречается
+	ASSERT_EQUAL(stats.empty_term_count, 0);
+	ASSERT_EQUAL(stats.removed_posting_count, 0);
+	ASSERT_EQUAL(server.FindTopDocuments("бежит"s).size(), 2);
+	const auto [words, status] = server.MatchDocument("попугай спит летит"s, 3);
+	ASSERT_EQUAL(words.size(), 2);
+}
+
+void TestAddDocuments() { // пакетное добавление дает тот же индекс, что и добавление по одному
+	const vector<string> texts = { "кошка бежит домой"s, "собака бежит домой"s, "кошка спит"s, "попугай летит домой"s };
+	SearchServer one_by_one("и в на"s);
+	SearchServer bulk("и в на"s);
+	vector<DocumentToAdd> documents;
+	for (int i = 0; i < static_cast<int>(texts.size()); ++i) {
+		const int id = 10 - i; // id в пакете не обязаны идти по порядку
+		one_by_one.AddDocument(id, texts[i], DocumentStatus::ACTUAL, { i });
+		documents.push_back({ id, texts[i], DocumentStatus::ACTUAL, { i } });
+	}
+	bulk.AddDocument(1, "кошка"s, DocumentStatus::BANNED, { 1 });
+	bulk.RemoveDocument(1);
+	bulk.AddDocuments(documents);
+	ASSERT_EQUAL(bulk.GetDocumentCount(), one_by_one.GetDocumentCount());
+	for (const string& query : { "кошка"s, "бежит домой -собака"s, "попугай спит"s }) {
+		const auto expected = one_by_one.FindTopDocuments(query);
+		const auto found = bulk.FindTopDocuments(execution::seq, query);
+		ASSERT_EQUAL(found.size(), expected.size());
+		for (size_t i = 0; i < found.size(); ++i) {
+			ASSERT_EQUAL(found[i].id, expected[i].id);
+			ASSERT_EQUAL(found[i].rating, expected[i].rating);
+			ASSERT(abs(found[i].relevance - expected[i].relevance) < MAX_RELEVANCE_DIFFERENCE);
+		}
+	}
+
+	// при ошибке в пакете сервер не меняется
+	const vector<DocumentToAdd> duplicate_ids = { { 20, "белка"sv }, { 20, "ёж"sv } };
+	const vector<DocumentToAdd> existing_id = { { 21, "белка"sv }, { 10, "ёж"sv } };
+	const vector<DocumentToAdd> invalid_word = { { 22, "белка"sv }, { 23, "ёж \x12"sv } };
+	for (const auto& invalid_documents : { duplicate_ids, existing_id, invalid_word }) {
+		try {
+			bulk.AddDocuments(execution::seq, invalid_documents);
+			ASSERT_HINT(false, "invalid batch must throw"s);
+		}
+		catch (const invalid_argument&) {
+		}
+		ASSERT_EQUAL(bulk.GetDocumentCount(), one_by_one.GetDocumentCount());
+		ASSERT(bulk.FindTopDocuments("белка"s).empty());
+	}
+}
+
+void TestSnapshot() { // сохранение и загрузка снимка
+	const string path = (filesystem::temp_directory_path() / "search_server_test.snapshot"s).string();
+	SearchServer server("и в на"s);
+	server.AddDocument(1, "кошка бежит домой"s, DocumentStatus::ACTUAL, { 1, 2 });
+	server.AddDocument(2, "собака бежит на улицу"s, DocumentStatus::BANNED, { 5 });
+	server.AddDocument(3, "попугай летит домой"s, DocumentStatus::ACTUAL, { -3 });
+	server.AddDocument(4, "кошка спит"s, DocumentStatus::ACTUAL, { 4 });
+	server.RemoveDocument(3); // удаленный документ в снимок не попадает
+	server.SaveSnapshot(path);
+
+	SearchServer loaded = SearchServer::LoadSnapshot(path);
+	ASSERT_EQUAL(loaded.GetDocumentCount(), server.GetDocumentCount());
+	ASSERT(loaded.GetMemoryStats().mapped_posting_bytes > 0);
+	ASSERT(loaded.GetMemoryStats().mapped_document_bytes > 0);
+	for (const string& query : { "кошка домой"s, "бежит -кошка"s, "попугай"s, "на улицу"s }) {
+		for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+			const auto expected = server.FindTopDocuments(query, status);
+			const auto found = loaded.FindTopDocuments(query, status);
+			ASSERT_EQUAL(found.size(), expected.size());
+			for (size_t i = 0; i < found.size(); ++i) {
+				ASSERT_EQUAL(found[i].id, expected[i].id);
+				ASSERT_EQUAL(found[i].rating, expected[i].rating);
+				ASSERT(abs(found[i].relevance - expected[i].relevance) < MAX_RELEVANCE_DIFFERENCE);
+			}
+		}
+	}
+
+	// загруженный сервер изменяется как обычный
+	loaded.AddDocument(5, "кошка летит"s, DocumentStatus::ACTUAL, { 1 });
+	loaded.RemoveDocument(1);
+	ASSERT_EQUAL(loaded.FindTopDocuments("кошка"s).size(), 2);
+	loaded.CompactIndex();
+	ASSERT_EQUAL(get<0>(loaded.MatchDocument("кошка летит"s, 5)).size(), 2);
+
+	// испорченный список слова обнаруживается при первом запросе с этим словом
+	{
+		fstream file(path, ios::in | ios::out | ios::binary);
+		SnapshotHeader header;
+		file.read(reinterpret_cast<char*>(&header), sizeof(header));
+		file.seekp(header.sections[static_cast<size_t>(SnapshotSection::POSTING_BLOCKS)].offset);
+		file.put('\x7f');
+	}
+	{
+		SearchServer corrupted = SearchServer::LoadSnapshot(path);
+		try {
+			corrupted.FindTopDocuments("кошка"s);
+			ASSERT_HINT(false, "corrupted posting list must not be read"s);
+		}
+		catch (const invalid_argument&) {
+		}
+	}
+
+	// испорченный файл не загружается
+	{
+		fstream file(path, ios::in | ios::out | ios::binary);
+		file.seekp(-1, ios::end);
+		file.put('\x7f');
+	}
+	try {
+		SearchServer::LoadSnapshot(path);
+		ASSERT_HINT(false, "corrupted snapshot must not load"s);
+	}
+	catch (const invalid_argument&) {
+	}
+	filesystem::remove(path);
+}
+
+void TestQueryCache() { // кэш результатов запросов
+	SearchServer server("и в на"s);
+	server.AddDocument(1, "кошка бежит домой"s, DocumentStatus::ACTUAL, { 1 });
+	server.AddDocument(2, "собака бежит на улицу"s, DocumentStatus::ACTUAL, { 2 });
+	server.AddDocument(3, "кошка спит"s, DocumentStatus::BANNED, { 3 });
+	server.SetQueryCacheCapacity(2);
+
+	const auto found = server.FindTopDocuments("кошка бежит -собака"s);
+	// тот же разобранный запрос: другой порядок, повтор, неизвестное и стоп-слово
+	ASSERT_EQUAL(server.FindTopDocuments("-собака бежит кошка кошка в попугай"s).size(), found.size());
+	auto stats = server.GetQueryCacheStats();
+	ASSERT_EQUAL(stats.hit_count, 1);
+	ASSERT_EQUAL(stats.miss_count, 1);
+
+	server.FindTopDocuments("кошка"s, DocumentStatus::BANNED); // статус входит в ключ
+	server.FindTopDocuments(execution::seq, "кошка"s);
+	stats = server.GetQueryCacheStats();
+	ASSERT_EQUAL(stats.miss_count, 3);
+	ASSERT_EQUAL(stats.eviction_count, 1);
+	ASSERT_EQUAL(stats.size, 2);
+
+	// после изменения индекса старый результат не возвращается
+	server.AddDocument(4, "кошка бежит"s, DocumentStatus::ACTUAL, { 4 });
+	const auto found_after_add = server.FindTopDocuments("кошка"s);
+	ASSERT_EQUAL(found_after_add.size(), 2);
+	ASSERT_EQUAL(server.GetQueryCacheStats().stale_count, 1);
+	server.RemoveDocument(4);
+	ASSERT_EQUAL(server.FindTopDocuments("кошка"s).size(), 1);
+
+	// фоновые слияния не меняют результатов и кэш не сбрасывают
+	for (int id = 10; id < 10 + static_cast<int>(WRITE_BUFFER_DOCUMENT_COUNT * SEGMENT_MERGE_FACTOR); ++id) {
+		server.AddDocument(id, "белка ищет орехи"s, DocumentStatus::ACTUAL, { id });
+	}
+	stats = server.GetQueryCacheStats();
+	server.FindTopDocuments("белка"s);
+	server.WaitForBackgroundMerges();
+	server.FindTopDocuments("белка"s);
+	ASSERT_EQUAL(server.GetQueryCacheStats().hit_count, stats.hit_count + 1);
+	ASSERT_EQUAL(server.GetQueryCacheStats().stale_count, stats.stale_count);
+
+	server.SetQueryCacheCapacity(0);
+	ASSERT_EQUAL(server.GetQueryCacheStats().capacity, 0);
+}
+
+void TestConcurrentReadsDuringWrites() { // поиск идет одновременно с добавлением и удалением документов
+	SearchServer server("и в на"s);
+	server.AddDocument(1, "кошка бежит домой"s, DocumentStatus::ACTUAL, { 1 });
+	server.AddDocument(2, "собака бежит на улицу"s, DocumentStatus::ACTUAL, { 2 });
+	server.AddDocument(3, "кошка спит"s, DocumentStatus::ACTUAL, { 3 });
+	server.SetQueryCacheCapacity(16);
+
+	atomic<bool> stop = false;
+	atomic<int> bad_results = 0;
+	vector<thread> readers;
+	for (int reader = 0; reader < 3; ++reader) {
+		readers.emplace_back([&] {
+			while (!stop) {
+				// документы со словом "кошка" не меняются, меняются только документы с "белка"
+				const auto cats = server.FindTopDocuments("кошка -белка"s);
+				if (cats.size() != 2 || cats[0].id != 3 || cats[1].id != 1) {
+					++bad_results;
+				}
+				for (const Document& document : server.FindTopDocuments(execution::seq, "белка кошка"s)) {
+					if (document.id != 1 && document.id != 3 && document.id < 100) {
+						++bad_results;
+					}
+				}
+				// слова не сравниваются: CompactIndex делает string_view недействительными
+				const auto [words, status] = server.MatchDocument("кошка белка -собака"s, 1);
+				if (words.size() != 1 || status != DocumentStatus::ACTUAL) {
+					++bad_results;
+				}
+			}
+			});
+	}
+
+	for (int id = 100; id < 400; ++id) {
+		server.AddDocument(id, "белка ищет орехи "s + to_string(id), DocumentStatus::ACTUAL, { id });
+		if (id >= 150 && id % 2 == 0) {
+			server.RemoveDocument(id - 50);
+		}
+		if (id % 100 == 0) {
+			server.CompactIndex();
+		}
+	}
+	stop = true;
+	for (thread& reader : readers) {
+		reader.join();
+	}
+	ASSERT_EQUAL(bad_results.load(), 0);
+	ASSERT_EQUAL(server.GetDocumentCount(), 3 + 300 - 125);
+	ASSERT(server.GetMemoryStats().segment_count < 3 * SEGMENT_MERGE_FACTOR);
+}
+
+void TestBackgroundMerges() { // буфер записи и фоновое слияние сегментов
+	SearchServer server("и в на"s);
+	const int document_count = 1000;
+	for (int id = 0; id < document_count; ++id) {
+		server.AddDocument(id, (id % 2 == 0 ? "белый кот "s : "черный пес "s) + to_string(id), DocumentStatus::ACTUAL, { id });
+	}
+	server.WaitForBackgroundMerges();
+	auto stats = server.GetMemoryStats();
+	ASSERT_EQUAL(stats.document_count, document_count);
+	ASSERT_EQUAL(stats.buffered_document_count, document_count % WRITE_BUFFER_DOCUMENT_COUNT);
+	// после слияний в каждом ярусе меньше SEGMENT_MERGE_FACTOR сегментов
+	ASSERT(stats.segment_count < 4 * SEGMENT_MERGE_FACTOR);
+	ASSERT_EQUAL(server.FindTopDocuments("кот"s, DocumentStatus::ACTUAL, document_count).size(), document_count / 2);
+	ASSERT_EQUAL(server.GetWordFrequencies(999).count("999"sv), 1);
+
+	// сегменты с большой долей удаленных переписываются фоновым потоком
+	for (int id = 0; id < document_count; ++id) {
+		if (id % 4 != 0) {
+			server.RemoveDocument(id);
+		}
+	}
+	server.WaitForBackgroundMerges();
+	stats = server.GetMemoryStats();
+	ASSERT_EQUAL(stats.document_count, document_count / 4);
+	ASSERT_EQUAL(stats.posting_count, document_count / 4 * 3);
+	ASSERT(stats.removed_posting_count * DELETED_DOCUMENTS_PURGE_RATIO < stats.posting_count + stats.removed_posting_count);
+	ASSERT_EQUAL(server.FindTopDocuments("кот"s, DocumentStatus::ACTUAL, document_count).size(), document_count / 4);
+	ASSERT(server.FindTopDocuments("пес"s).empty());
+}
+
+void TestSegmentDeletions() { // версии удалений одного сегмента делят журнал и не видят более поздних удалений
+	vector<SegmentDocument> documents;
+	for (int id = 0; id < 10; ++id) {
+		documents.push_back({ id, 0, DocumentStatus::ACTUAL, { { 0, 0.5 }, { static_cast<TermId>(1 + id % 2), 0.5 } }, 2 });
+	}
+	const IndexSegment segment(execution::seq, documents);
+	const SegmentDeletions first(nullptr, segment, 2);
+	const SegmentDeletions second(&first, segment, 3);
+	const SegmentDeletions third(&second, segment, 4);
+	ASSERT(first.Contains(2) && !first.Contains(3) && !first.Contains(4));
+	ASSERT(third.Contains(2) && third.Contains(3) && third.Contains(4));
+	ASSERT_EQUAL(first.size(), 1u);
+	ASSERT_EQUAL(third.size(), 3u);
+	ASSERT_EQUAL(first.GetDocumentFrequency(0), 1u);
+	ASSERT_EQUAL(second.GetDocumentFrequency(0), 2u);
+	ASSERT_EQUAL(third.GetDocumentFrequency(1), 2u); // документы 2 и 4
+	ASSERT_EQUAL(third.GetDocumentFrequency(2), 1u);
+	ASSERT_EQUAL(third.GetPostingCount(), 6u);
+
+	// ветка от старой версии получает свой журнал и не видит удалений соседней ветки
+	const SegmentDeletions branch(&first, segment, 7);
+	ASSERT(branch.Contains(2) && branch.Contains(7) && !branch.Contains(3));
+	ASSERT(!third.Contains(7));
+	ASSERT_EQUAL(branch.GetDocumentFrequency(2), 1u);
+	ASSERT_EQUAL(branch.GetDocumentFrequency(1), 1u);
+}
+
+void TestPostingCompression() { // сжатие списков слов
+	mt19937 generator(15);
+	// блоки с шириной от 0 до 32 бит, полные и неполные
+	for (const uint32_t max_delta : { 0u, 1u, 1000u, UINT32_MAX / 200 }) {
+		for (const size_t size : { size_t{ 1 }, size_t{ 77 }, POSTING_BLOCK_SIZE }) {
+			vector<uint32_t> documents(size);
+			vector<uint32_t> counts(size);
+			uint32_t document = 5;
+			for (size_t i = 0; i < size; ++i) {
+				document += 1 + uniform_int_distribution<uint32_t>(0, max_delta)(generator);
+				documents[i] = document;
+				counts[i] = max_delta == UINT32_MAX / 200 ? UINT32_MAX - static_cast<uint32_t>(i) : 1 + static_cast<uint32_t>(i % 3);
+			}
+			vector<uint32_t> data(3, 0);
+			const PostingBlock block = EncodePostingBlock(documents.data(), counts.data(), size, 5, data);
+			ASSERT_EQUAL(block.data_offset, 3u);
+			ASSERT_EQUAL(data.size(), 3 + GetPostingBlockWords(block));
+			ASSERT_EQUAL(block.last_document, static_cast<int>(documents.back()));
+			uint32_t decoded_documents[POSTING_BLOCK_SIZE];
+			uint32_t decoded_counts[POSTING_BLOCK_SIZE];
+			DecodePostingBlock(block, data.data(), 5, decoded_documents, decoded_counts);
+			ASSERT(equal(documents.begin(), documents.end(), decoded_documents));
+			ASSERT(equal(counts.begin(), counts.end(), decoded_counts));
+		}
+	}
+
+	// слово из каждого документа: номера идут подряд, числа вхождений малы, поэтому на постинг меньше байта
+	const int document_count = 1000;
+	vector<vector<TermFrequency>> documents(document_count);
+	vector<int> word_counts(document_count);
+	for (int i = 0; i < document_count; ++i) {
+		word_counts[i] = 4;
+		documents[i].push_back({ 0, (1 + i % 3) / 4.0 });
+		if (i % 7 == 0) {
+			documents[i].push_back({ 1, 0.25 });
+		}
+	}
+	const InvertedIndex index(execution::par, 2, { documents.begin(), documents.end() }, word_counts);
+	ASSERT_EQUAL(index.GetPostingCount(), document_count + (document_count + 6) / 7);
+	ASSERT(index.GetBlocks().size_bytes() + index.GetData().size_bytes() < index.GetPostingCount());
+
+	int expected = 0;
+	index.Find(0).ForEach([&](int ordinal, uint32_t count) {
+		ASSERT_EQUAL(ordinal, expected);
+		ASSERT_EQUAL(count, static_cast<uint32_t>(1 + ordinal % 3));
+		++expected;
+		});
+	ASSERT_EQUAL(expected, document_count);
+	// пропуск блоков по номеру документа
+	vector<int> ordinals;
+	index.Find(1).ForEach(300, 330, [&](int ordinal, uint32_t) {
+		ordinals.push_back(ordinal);
+		});
+	ASSERT(ordinals == (vector<int>{ 301, 308, 315, 322, 329 }));
+}
+
+void TestMinusWordsExclusion() { // минус-слова отсеивают документы до оценки, и массивом, и битовой картой
+	SearchServer server(""s);
+	const int document_count = 2000;
+	// одним пакетом, чтобы все документы попали в один сегмент
+	vector<string> texts;
+	for (int id = 0; id < document_count; ++id) {
+		string text = "текст"s;
+		if (id % 20 == 0) {
+			text += " кот"s;
+		}
+		if (id % 50 == 0) {
+			text += " редкий"s;
+		}
+		if (id % 29 == 0) {
+			text += " частый"s;
+		}
+		texts.push_back(move(text));
+	}
+	vector<DocumentToAdd> documents;
+	for (int id = 0; id < document_count; ++id) {
+		documents.push_back({ id, texts[id], DocumentStatus::ACTUAL, { 1 } });
+	}
+	server.AddDocuments(documents);
+
+	// 40 документов со словом "редкий" хранятся массивом, 69 со словом "частый" - битовой картой
+	for (const string& query : { "кот -редкий"s, "кот -частый"s, "кот -редкий -частый"s }) {
+		const bool exclude_rare = query.find("-редкий"s) != string::npos;
+		const bool exclude_frequent = query.find("-частый"s) != string::npos;
+		set<int> expected;
+		for (int id = 0; id < document_count; id += 20) {
+			if (!(exclude_rare && id % 50 == 0) && !(exclude_frequent && id % 29 == 0)) {
+				expected.insert(id);
+			}
+		}
+		for (const auto& documents : { server.FindTopDocuments(execution::seq, query, DocumentStatus::ACTUAL, document_count),
+			server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, document_count) }) {
+			set<int> found;
+			for (const Document& document : documents) {
+				found.insert(document.id);
+			}
+			ASSERT(found == expected);
+		}
+	}
+}
+
+void TestQueryPruning() { // отсечение по верхним оценкам не меняет результат, но пропускает постинги
+	SearchServer server("и"s);
+	const int document_count = 3000;
+	vector<string> texts;
+	for (int id = 0; id < document_count; ++id) {
+		// "кот" почти в каждом документе, "редкий" - в немногих и с большим idf
+		string text = "кот"s;
+		for (int i = 0; i < id % 4; ++i) {
+			text += " кот"s;
+		}
+		text += id % 3 == 0 ? " пес"s : " мышь"s;
+		if (id % 97 == 0) {
+			text += " редкий"s;
+		}
+		texts.push_back(move(text));
+	}
+	vector<DocumentToAdd> documents;
+	for (int id = 0; id < document_count; ++id) {
+		documents.push_back({ id, texts[id], DocumentStatus::ACTUAL, { id } }); // рейтинги различны, поэтому порядок однозначен
+	}
+	server.AddDocuments(documents);
+
+	for (const string& query : { "кот редкий"s, "кот пес -редкий"s, "редкий мышь"s }) {
+		// при top_count, сравнимом с числом документов, отсечение не включается
+		auto expected = server.FindTopDocuments(execution::seq, query, DocumentStatus::ACTUAL, document_count);
+		expected.resize(min<size_t>(expected.size(), MAX_RESULT_DOCUMENT_COUNT));
+		for (const auto& found : { server.FindTopDocuments(execution::seq, query), server.FindTopDocuments(execution::par, query) }) {
+			ASSERT_EQUAL(found.size(), expected.size());
+			for (size_t i = 0; i < found.size(); ++i) {
+				ASSERT_EQUAL(found[i].id, expected[i].id);
+				ASSERT(abs(found[i].relevance - expected[i].relevance) < MAX_RELEVANCE_DIFFERENCE);
+			}
+		}
+	}
+	ASSERT(server.GetQueryPruningStats().skipped_posting_count > 0);
+}
+
+void TestStatusFilter() { // фильтр по статусу через битовые карты сегментов дает то же, что предикат
+	SearchServer server("и"s);
+	vector<string> texts;
+	for (int id = 0; id < 300; ++id) {
+		texts.push_back("кот номер "s + to_string(id % 7));
+	}
+	// первый пакет целиком ACTUAL, во втором статусы чередуются
+	for (int batch = 0; batch < 2; ++batch) {
+		vector<DocumentToAdd> documents;
+		for (int id = batch * 150; id < (batch + 1) * 150; ++id) {
+			const DocumentStatus status = batch == 0 ? DocumentStatus::ACTUAL : static_cast<DocumentStatus>(id % DOCUMENT_STATUS_COUNT);
+			documents.push_back({ id, texts[id], status, { id } });
+		}
+		server.AddDocuments(documents);
+	}
+	server.RemoveDocument(151);
+
+	for (size_t status = 0; status < DOCUMENT_STATUS_COUNT; ++status) {
+		const DocumentStatus document_status = static_cast<DocumentStatus>(status);
+		for (const size_t top_count : { size_t{ 3 }, size_t{ 300 } }) {
+			const auto found = server.FindTopDocuments("кот"s, document_status, top_count);
+			const auto expected = server.FindTopDocuments("кот"s, [document_status](int, DocumentStatus s, int) { return s == document_status; }, top_count);
+			ASSERT_EQUAL(found.size(), expected.size());
+			for (size_t i = 0; i < found.size(); ++i) {
+				ASSERT_EQUAL(found[i].id, expected[i].id);
+			}
+		}
+	}
+	ASSERT_EQUAL(server.FindTopDocuments("кот"s, DocumentStatus::ACTUAL, 300).size(), 150 + 37);
+	ASSERT_EQUAL(server.FindTopDocuments("кот"s, DocumentStatus::REMOVED, 300).size(), 38 - 1); // 151 удален
+}
+
+void TestTypedPredicates() { // типизированные предикаты дают то же, что равносильные лямбды
+	SearchServer server("и"s);
+	vector<string> texts;
+	for (int id = 0; id < 200; ++id) {
+		texts.push_back("кот номер "s + to_string(id % 11));
+	}
+	// во втором пакете рейтинги отрицательные, и предикат по рейтингу пропускает его целиком
+	for (int batch = 0; batch < 2; ++batch) {
+		vector<DocumentToAdd> documents;
+		for (int id = batch * 100; id < (batch + 1) * 100; ++id) {
+			const int rating = batch == 0 ? id % 10 : -id;
+			documents.push_back({ id, texts[id], static_cast<DocumentStatus>(id % 3), { rating } });
+		}
+		server.AddDocuments(documents);
+	}
+
+	const auto check = [&server](const auto& typed_predicate, const auto& lambda) {
+		for (const size_t top_count : { size_t{ 5 }, size_t{ 200 } }) {
+			const auto found = server.FindTopDocuments("кот номер 3"s, typed_predicate, top_count);
+			const auto expected = server.FindTopDocuments("кот номер 3"s, lambda, top_count);
+			ASSERT_EQUAL(found.size(), expected.size());
+			for (size_t i = 0; i < found.size(); ++i) {
+				ASSERT_EQUAL(found[i].id, expected[i].id);
+			}
+		}
+		return server.FindTopDocuments(execution::seq, "кот"s, typed_predicate, 200).size();
+	};
+	ASSERT_EQUAL(check(ByStatus<DocumentStatus::BANNED>{}, [](int, DocumentStatus status, int) { return status == DocumentStatus::BANNED; }), 66);
+	ASSERT_EQUAL(check(StatusIs{ DocumentStatus::IRRELEVANT }, [](int, DocumentStatus status, int) { return status == DocumentStatus::IRRELEVANT; }), 67);
+	ASSERT_EQUAL(check(RatingAtLeast<7>{}, [](int, DocumentStatus, int rating) { return rating >= 7; }), 30);
+	ASSERT_EQUAL(check(AllOf(StatusIs{ DocumentStatus::ACTUAL }, RatingAtLeast<5>{}),
+		[](int, DocumentStatus status, int rating) { return status == DocumentStatus::ACTUAL && rating >= 5; }), 17);
+	ASSERT(check(ByStatus<DocumentStatus::REMOVED>{}, [](int, DocumentStatus status, int) { return status == DocumentStatus::REMOVED; }) == 0);
+}
+
+void TestSparseDocumentIds() { // разреженные id переводятся во внутренние номера, обход идет по возрастанию id
+	SearchServer server("и"s);
+	const vector<int> ids = { 2'000'000'000, 7, 1'000'000, 42, 2'147'483'647, 0 };
+	for (const int id : ids) {
+		server.AddDocument(id, "кот "s + to_string(id % 5), DocumentStatus::ACTUAL, { id % 100 });
+	}
+	const vector<DocumentToAdd> batch = { { 500'000'000, "кот пес"sv }, { 3, "кот"sv } };
+	server.AddDocuments(batch);
+	server.RemoveDocument(42);
+	server.RemoveDocument(43); // неизвестный id ничего не меняет
+
+	const vector<int> expected = { 0, 3, 7, 1'000'000, 500'000'000, 2'000'000'000, 2'147'483'647 };
+	ASSERT(vector<int>(server.begin(), server.end()) == expected);
+	ASSERT_EQUAL(server.GetDocumentCount(), static_cast<int>(expected.size()));
+	set<int> found;
+	for (const Document& document : server.FindTopDocuments("кот"s, DocumentStatus::ACTUAL, 100)) {
+		found.insert(document.id);
+	}
+	ASSERT(found == set<int>(expected.begin(), expected.end()));
+	try {
+		server.AddDocument(7, "пес"s, DocumentStatus::ACTUAL, { 1 });
+		ASSERT_HINT(false, "duplicate id must be rejected"s);
+	}
+	catch (const invalid_argument&) {
+	}
+}
+
+void TestSplitIntoWordsSinglePass() { // разбиение блоками совпадает с посимвольным и находит управляющие символы
+	mt19937 generator(21);
+	const string alphabet = "ab \t\x1f\x7f\xd0\xba"s; // пробел, управляющие, DEL и байты UTF-8
+	vector<string_view> words;
+	for (int iteration = 0; iteration < 2000; ++iteration) {
+		string text;
+		const size_t length = uniform_int_distribution<size_t>(0, 70)(generator);
+		for (size_t i = 0; i < length; ++i) {
+			// управляющие символы реже, чтобы встречались и тексты без них
+			const size_t max_index = iteration % 2 == 0 ? 2 : alphabet.size() - 1;
+			text += alphabet[uniform_int_distribution<size_t>(0, max_index)(generator)];
+		}
+
+		vector<string_view> expected;
+		size_t expected_invalid = WORDS_ARE_VALID;
+		string_view rest = text;
+		while (true) {
+			const size_t space = rest.find(' ');
+			const string_view word = rest.substr(0, space);
+			if (expected_invalid == WORDS_ARE_VALID && any_of(word.begin(), word.end(), [](char c) { return c >= '\0' && c < ' '; })) {
+				expected_invalid = expected.size();
+			}
+			expected.push_back(word);
+			if (space == rest.npos) {
+				break;
+			}
+			rest.remove_prefix(space + 1);
+		}
+
+		ASSERT_EQUAL(SplitIntoWords(text, words), expected_invalid);
+		ASSERT(words == expected);
+	}
+}
+
+#ifdef SEARCH_SERVER_COUNT_ALLOCATIONS
+void TestQueryWithoutAllocations() { // повторный последовательный запрос не выделяет память
+	SearchServer server("и в на"s);
+	const int document_count = 3000;
+	for (int id = 0; id < document_count; ++id) {
+		string text = "кот"s;
+		if (id % 3 == 0) {
+			text += " пес"s;
+		}
+		if (id % 5 == 0) {
+			text += " ошейник"s;
+		}
+		if (id % 97 == 0) {
+			text += " хвост"s;
+		}
+		server.AddDocument(id, text + " и слово"s + to_string(id % 40), DocumentStatus::ACTUAL, { id });
+	}
+	server.WaitForBackgroundMerges();
+
+	// плотное и разреженное накопление, отсечение по верхним оценкам, минус-слова массивом и битовой картой
+	const vector<string> queries = { "кот"s, "пес слово7"s, "хвост"s, "пес -ошейник"s, "хвост -кот"s, "слово3 -хвост"s };
+	const auto is_even = [](int document_id, DocumentStatus, int) {
+		return document_id % 2 == 0;
+	};
+	vector<Document> documents;
+	for (int round = 0; round < 2; ++round) {
+		for (const string& query : queries) {
+			const size_t allocation_count_before = allocation_count;
+			server.FindTopDocuments(execution::seq, query, StatusIs{ DocumentStatus::ACTUAL }, documents, 20);
+			server.FindTopDocuments(execution::seq, query, is_even, documents);
+			// строки аргументов ASSERT тоже выделяют память, поэтому счетчик снимается до проверки
+			const size_t query_allocation_count = allocation_count - allocation_count_before;
+			// первый круг заполняет буферы потока
+			if (round > 0) {
+				ASSERT_EQUAL_HINT(query_allocation_count, 0u, query);
+			}
+		}
+	}
+
+	// результат тот же, что у запроса, возвращающего вектор
+	for (const string& query : queries) {
+		server.FindTopDocuments(execution::seq, query, is_even, documents);
+		const auto expected = server.FindTopDocuments(execution::seq, query, is_even);
+		ASSERT_EQUAL(documents.size(), expected.size());
+		for (size_t i = 0; i < documents.size(); ++i) {
+			ASSERT_EQUAL(documents[i].id, expected[i].id);
+		}
+	}
+}
+#endif
+
+void TestStopWordSet() { // совершенный хеш стоп-слов находит каждое слово и только их
+	mt19937 generator(23);
+	const string letters = "абвгдежзик"s + "xyz"s;
+	set<string, less<>> words;
+	while (words.size() < 600) {
+		string word;
+		// длинные слова попадают в общий бит длины 63
+		const size_t length = uniform_int_distribution<size_t>(1, words.size() % 50 == 0 ? 40 : 8)(generator);
+		for (size_t i = 0; i < length; ++i) {
+			word += letters[uniform_int_distribution<size_t>(0, letters.size() - 1)(generator)];
+		}
+		words.insert(word);
+	}
+	const StopWordSet stop_words(words);
+	ASSERT_EQUAL(stop_words.size(), words.size());
+	ASSERT(equal(stop_words.begin(), stop_words.end(), words.begin(), words.end()));
+	for (const string& word : words) {
+		ASSERT_HINT(stop_words.Contains(word), word);
+		// та же длина и тот же первый байт проходят предварительный фильтр и проверяются по таблице
+		for (const string& other : { word + "z"s, word.substr(0, word.size() - 1), "q"s + word.substr(1), word.substr(0, word.size() - 1) + "q"s }) {
+			ASSERT_EQUAL_HINT(stop_words.Contains(other), words.count(other) > 0, other);
+		}
+	}
+	ASSERT(!stop_words.Contains(""sv));
+
+	const StopWordSet no_stop_words;
+	ASSERT(!no_stop_words.Contains("и"sv));
+	ASSERT(!no_stop_words.Contains(""sv));
+
+	// все перегрузки конструктора сервера используют тот же набор
+	const auto check_server = [](SearchServer& server) {
+		server.AddDocument(1, "кот в мешке"s, DocumentStatus::ACTUAL, { 1 });
+		ASSERT(server.FindTopDocuments("в"s).empty());
+		ASSERT_EQUAL(server.FindTopDocuments("кот на"s).size(), 1u);
+	};
+	const string stop_words_text = "и в  на"s;
+	SearchServer text_server(stop_words_text);
+	check_server(text_server);
+	SearchServer view_server(string_view{ stop_words_text });
+	check_server(view_server);
+	SearchServer container_server(vector<string>{ "и"s, "в"s, "на"s, "в"s });
+	check_server(container_server);
+}
+
+void TestRemoveDuplicates() { // дубликаты ищутся по отпечаткам, остается документ с меньшим id
+	mt19937 generator(24);
+	const vector<string> words = { "кот"s, "пес"s, "мышь"s, "хвост"s, "ошейник"s, "и"s };
+	SearchServer server("и"s);
+	SearchServer incremental_server("и"s);
+	DuplicateDetector detector(incremental_server);
+	map<set<string>, int> originals; // набор слов без стоп-слов - первый документ с ним
+	vector<int> expected_duplicates;
+	for (int id = 0; id < 600; id += 3) {
+		const int word_count = uniform_int_distribution<int>(1, 4)(generator);
+		string text;
+		set<string> word_set;
+		for (int i = 0; i < word_count; ++i) {
+			const string& word = words[uniform_int_distribution<size_t>(0, words.size() - 1)(generator)];
+			text += (i > 0 ? " "s : ""s) + word;
+			if (word != "и"s) {
+				word_set.insert(word);
+			}
+		}
+		server.AddDocument(id, text, DocumentStatus::ACTUAL, { 1 });
+		const auto original = detector.AddDocument(id, text, DocumentStatus::ACTUAL, { 1 });
+
+		const auto [it, inserted] = originals.emplace(word_set, id);
+		if (inserted) {
+			ASSERT(!original.has_value());
+		}
+		else {
+			ASSERT(original.has_value());
+			ASSERT_EQUAL(*original, it->second);
+			expected_duplicates.push_back(id);
+		}
+	}
+
+	ostringstream output;
+	auto* const cout_buffer = cout.rdbuf(output.rdbuf());
+	RemoveDuplicates(server);
+	cout.rdbuf(cout_buffer);
+
+	string expected_output;
+	for (const int id : expected_duplicates) {
+		expected_output += "Found duplicate document id "s + to_string(id) + "\n"s;
+	}
+	ASSERT_EQUAL(output.str(), expected_output);
+	ASSERT_EQUAL(server.GetDocumentCount(), static_cast<int>(originals.size()));
+	for (const auto& [word_set, id] : originals) {
+		ASSERT(binary_search(server.begin(), server.end(), id));
+	}
+
+	// детектор забывает удаленные документы, а после CompactIndex сравнивает по тексту слов
+	SearchServer detector_server("и"s);
+	DuplicateDetector incremental_detector(detector_server);
+	ASSERT(!incremental_detector.AddDocument(1, "кот и пес"s, DocumentStatus::ACTUAL, { 1 }).has_value());
+	ASSERT_EQUAL(incremental_detector.AddDocument(2, "пес кот кот"s, DocumentStatus::ACTUAL, { 1 }).value_or(-1), 1);
+	ASSERT(!incremental_detector.AddDocument(3, "пес"s, DocumentStatus::ACTUAL, { 1 }).has_value());
+	detector_server.RemoveDocument(1);
+	ASSERT_EQUAL(incremental_detector.AddDocument(4, "кот пес"s, DocumentStatus::ACTUAL, { 1 }).value_or(-1), 2);
+	detector_server.RemoveDocument(2);
+	detector_server.CompactIndex();
+	ASSERT_EQUAL(incremental_detector.AddDocument(5, "пес и"s, DocumentStatus::ACTUAL, { 1 }).value_or(-1), 3);
+	ASSERT_EQUAL(incremental_detector.AddDocument(6, "пес кот"s, DocumentStatus::ACTUAL, { 1 }).value_or(-1), 4);
+}
+
+void TestFindNearDuplicates() { // почти-дубликаты собираются в группы по порогу Жаккара
+	mt19937 generator(25);
+	const auto make_word = [](int index) {
+		return "слово"s + to_string(index);
+	};
+	SearchServer server("и"s);
+	vector<vector<int>> document_words; // по id
+	for (int id = 0; id < 300; ++id) {
+		vector<int> words;
+		if (id % 3 != 0 && !document_words.empty()) {
+			// копия одного из прошлых документов с одним замененным словом: сходство 11/13
+			words = document_words[uniform_int_distribution<size_t>(0, document_words.size() - 1)(generator)];
+			words[uniform_int_distribution<size_t>(0, words.size() - 1)(generator)] = 1000 + id;
+		}
+		else {
+			set<int> unique_words;
+			while (unique_words.size() < 12) {
+				unique_words.insert(uniform_int_distribution<int>(0, 999)(generator));
+			}
+			words.assign(unique_words.begin(), unique_words.end());
+		}
+		string text = "и"s;
+		for (const int word : words) {
+			text += " "s + make_word(word);
+		}
+		server.AddDocument(id, text, DocumentStatus::ACTUAL, { 1 });
+		document_words.push_back(words);
+	}
+
+	// перебор всех пар
+	const auto find_expected_clusters = [&](double threshold) {
+		const int document_count = static_cast<int>(document_words.size());
+		vector<int> component(document_count);
+		iota(component.begin(), component.end(), 0);
+		for (int lhs = 0; lhs < document_count; ++lhs) {
+			const set<int> lhs_words(document_words[lhs].begin(), document_words[lhs].end());
+			for (int rhs = lhs + 1; rhs < document_count; ++rhs) {
+				const set<int> rhs_words(document_words[rhs].begin(), document_words[rhs].end());
+				size_t intersection = 0;
+				for (const int word : rhs_words) {
+					intersection += lhs_words.count(word);
+				}
+				if (static_cast<double>(intersection) / (lhs_words.size() + rhs_words.size() - intersection) >= threshold) {
+					const int old_component = component[rhs];
+					const int new_component = component[lhs];
+					for (int& value : component) {
+						if (value == old_component) {
+							value = new_component;
+						}
+					}
+				}
+			}
+		}
+		map<int, vector<int>> clusters;
+		for (int id = 0; id < document_count; ++id) {
+			clusters[component[id]].push_back(id);
+		}
+		vector<vector<int>> result;
+		for (auto& [root, ids] : clusters) {
+			if (ids.size() > 1) {
+				result.push_back(move(ids));
+			}
+		}
+		sort(result.begin(), result.end());
+		return result;
+	};
+
+	for (const double threshold : { 0.8, 0.6 }) {
+		const auto clusters = FindNearDuplicates(server, threshold);
+		ASSERT(!clusters.empty());
+		ASSERT(clusters == find_expected_clusters(threshold));
+	}
+	// при пороге 1 остаются только точные дубликаты, а их здесь нет
+	ASSERT(FindNearDuplicates(server, 1.0).empty());
+
+	try {
+		FindNearDuplicates(server, 1.5);
+		ASSERT(false);
+	}
+	catch (const invalid_argument&) {
+	}
+
+	// большая группа одинаковых документов: кандидаты связываются с первым документом корзины, а не попарно
+	SearchServer copies(""s);
+	const int copy_count = 2000;
+	for (int id = 0; id < copy_count; ++id) {
+		copies.AddDocument(id, id % 2 == 0 ? "белый кот и модный ошейник"s : "белый кот и модный хвост"s, DocumentStatus::ACTUAL, { 1 });
+	}
+	const auto copy_clusters = FindNearDuplicates(copies, 0.6);
+	ASSERT_EQUAL(copy_clusters.size(), 1u);
+	ASSERT_EQUAL(copy_clusters[0].size(), static_cast<size_t>(copy_count));
+}
+
+void TestDurationStats() { // замеры завершившихся потоков остаются в сводке, максимум точный
+	static const ProfileLabel label("TestDurationStats"s);
+	thread([] {
+		LogDuration::RecordDuration(label.GetId(), 1000);
+		LogDuration::RecordDuration(label.GetId(), 1234567);
+		}).join();
+	LogDuration::RecordDuration(label.GetId(), 10);
+	const auto stats = GetDurationStats();
+	const auto it = find_if(stats.begin(), stats.end(), [](const DurationStats& stats) {
+		return stats.label == "TestDurationStats"s;
+		});
+	ASSERT(it != stats.end() && it->is_profiled);
+	ASSERT_EQUAL(it->count, 3u);
+	ASSERT_EQUAL(it->max, 1234567u);
+	ASSERT(it->p50 <= it->p99 && it->p99 <= it->p999 && it->p999 <= it->max);
+	ASSERT_EQUAL(it->p999, it->max); // верхняя граница корзины ограничена точным максимумом
+}
+
 void PrintDocument(const Document& document) {
 	cout << "{ "s
 		<< "document_id = "s << document.id << ", "s
@@ -463,9 +1436,36 @@ int main() {
 		TestRelevanceTop();
 		TestSearchStatus();
 		FilterResultPlusPredicat();
+		TestTopDocumentCount();
+		TestProcessQueries();
+		TestRemoveDocumentAndCompact();
+		TestAddDocuments();
+		TestSnapshot();
+		TestQueryCache();
+		TestConcurrentReadsDuringWrites();
+		TestBackgroundMerges();
+		TestSegmentDeletions();
+		TestPostingCompression();
+		TestMinusWordsExclusion();
+		TestQueryPruning();
+		TestStatusFilter();
+		TestTypedPredicates();
+		TestSparseDocumentIds();
+		TestSplitIntoWordsSinglePass();
+#ifdef SEARCH_SERVER_COUNT_ALLOCATIONS
+		TestQueryWithoutAllocations();
+#endif
+		TestStopWordSet();
+		TestRemoveDuplicates();
+		TestFindNearDuplicates();
+		TestDurationStats();
 
 	}
 
+#ifdef SEARCH_SERVER_BENCHMARKS
+	BenchmarkConcurrentMapBuckets();
+#endif
+
 	SearchServer search_server("and with"s);
 	int id = 0;
 	for (
@@ -493,6 +1493,8 @@ int main() {
 	for (const Document& document : search_server.FindTopDocuments(execution::par, "curly nasty cat"s, [](int document_id, DocumentStatus status, int rating) { return document_id % 2 == 0; })) {
 		PrintDocument(document);
 	}
+
+	PrintDurationSummary(cerr);
 	return 0;
 }
 
@@ -2,12 +2,14 @@
 #include "document.h" 
 #include "request_queue.h"  
 #include "paginator.h"  
+#include "snapshot.h"
 #include <string> 
 #include <vector> 
 #include <stdexcept> 
 #include <iostream> 
 #include <numeric> // for std::accumulate() 
 #include <algorithm> // std::transform // std::unique // std::copy_if
+#include <thread> // std::thread::hardware_concurrency
 
 SearchServer::SearchServer(const std::string& stop_words_text) : SearchServer(
 	SplitIntoWords(std::string_view(stop_words_text))) {
@@ -17,33 +19,160 @@ SearchServer::SearchServer(std::string_view stop_words_text) : SearchServer(Spli
 
 void SearchServer::AddDocument(int document_id, std::string_view document, DocumentStatus status,
 	const std::vector<int>& ratings) {
+	LOG_DURATION("SearchServer::AddDocument");
+	std::lock_guard guard(write_mutex_);
 
-	if ((document_id < 0) || (documents_.count(document_id) > 0)) {
+	if ((document_id < 0) || HasDocumentId(document_id)) {
 		throw std::invalid_argument("Invalid document_id"); //   id < 0    id 
 	}
 
-	storage.emplace_back(document);
-
-	const auto words = SplitIntoWordsNoStop(storage.back()); //   
+	thread_local std::vector<std::string_view> words;
+	SplitIntoWordsNoStop(document, words); //   
 
 	const double inv_word_count = 1.0 / words.size();
 
+	std::map<TermId, double> term_freqs;
+
 	for (const std::string_view word : words) {
-		word_to_document_freqs_[word][document_id] += inv_word_count;
+		term_freqs[terms_->Intern(word)] += inv_word_count;
+	}
 
-		get_document_freqs[document_id][word] += inv_word_count;
+	//     ,     
+	SegmentDocument segment_document{ document_id, ComputeAverageRating(ratings), status, {}, static_cast<int>(words.size()) };
+	segment_document.term_freqs.reserve(term_freqs.size());
+	for (const auto& [term_id, term_freq] : term_freqs) {
+		segment_document.term_freqs.push_back({ term_id, term_freq });
 	}
+	const auto index = LoadIndex();
+	auto segments = index->segments;
+	WriteBufferState write_buffer = index->write_buffer;
+	write_buffer_->Put(write_buffer.document_count++, std::move(segment_document));
+	write_buffer.buffer = write_buffer_;
+	if (write_buffer.IsFull()) {
+		SegmentState frozen = FreezeWriteBuffer(write_buffer);
+		if (frozen.segment) {
+			segments.push_back(std::move(frozen));
+		}
+		write_buffer = {};
+		write_buffer_ = std::make_shared<WriteBuffer>();
+	}
+	document_ids_.insert(std::upper_bound(document_ids_.begin(), document_ids_.end(), document_id), document_id);
+	Publish(std::move(segments), std::move(write_buffer), true);
+}
 
-	documents_.emplace(document_id, DocumentData{ ComputeAverageRating(ratings), status });
+void SearchServer::AddDocuments(const std::vector<DocumentToAdd>& documents) {
+	AddDocuments(std::execution::par, documents);
+}
 
-	document_ids_.insert(document_id);
+void SearchServer::AddDocuments(std::execution::sequenced_policy policy, const std::vector<DocumentToAdd>& documents) {
+	AddDocumentsImpl(policy, documents);
 }
 
-std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status) const {
-	return FindTopDocuments(
-		raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-			return document_status == status;
+void SearchServer::AddDocuments(std::execution::parallel_policy policy, const std::vector<DocumentToAdd>& documents) {
+	AddDocumentsImpl(policy, documents);
+}
+
+template <typename ExecutionPolicy>
+void SearchServer::AddDocumentsImpl(ExecutionPolicy policy, const std::vector<DocumentToAdd>& documents) {
+	LOG_DURATION("SearchServer::AddDocuments");
+	std::lock_guard guard(write_mutex_);
+
+	std::vector<size_t> order(documents.size()); //      id
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(policy, order.begin(), order.end(), [&documents](size_t lhs, size_t rhs) {
+		return documents[lhs].id < documents[rhs].id;
+		});
+	for (size_t i = 0; i < order.size(); ++i) {
+		const int document_id = documents[order[i]].id;
+		if ((document_id < 0) || HasDocumentId(document_id) || (i > 0 && documents[order[i - 1]].id == document_id)) {
+			throw std::invalid_argument("Invalid document_id"); //   id < 0    id 
+		}
+	}
+
+	struct ParsedDocument {
+		std::vector<std::pair<std::string_view, double>> word_freqs; //  
+		std::vector<std::string_view> new_words; // ,    
+		std::vector<TermFrequency> term_freqs;
+		int word_count = 0;
+		std::string error;
+	};
+	std::vector<ParsedDocument> parsed_documents(documents.size());
+
+	// 1.   ;      ,   
+	std::for_each(policy, order.begin(), order.end(), [&](size_t index) {
+		ParsedDocument& parsed = parsed_documents[index];
+		try {
+			thread_local std::vector<std::string_view> words;
+			SplitIntoWordsNoStop(documents[index].text, words);
+			const double inv_word_count = 1.0 / words.size();
+			parsed.word_count = static_cast<int>(words.size());
+			std::sort(words.begin(), words.end());
+			for (const std::string_view word : words) {
+				if (parsed.word_freqs.empty() || parsed.word_freqs.back().first != word) {
+					parsed.word_freqs.push_back({ word, 0.0 });
+				}
+				parsed.word_freqs.back().second += inv_word_count;
+			}
+			for (const auto& [word, term_freq] : parsed.word_freqs) {
+				if (terms_->Find(word) == NO_TERM) {
+					parsed.new_words.push_back(word);
+				}
+			}
+		}
+		catch (const std::invalid_argument& error) {
+			parsed.error = error.what();
+		}
+		});
+	for (const ParsedDocument& parsed : parsed_documents) {
+		if (!parsed.error.empty()) {
+			throw std::invalid_argument(parsed.error);
+		}
+	}
+
+	// 2.       ,      
+	for (const size_t index : order) {
+		for (const std::string_view word : parsed_documents[index].new_words) {
+			terms_->Intern(word);
+		}
+	}
+	std::for_each(policy, order.begin(), order.end(), [&](size_t index) {
+		ParsedDocument& parsed = parsed_documents[index];
+		parsed.term_freqs.reserve(parsed.word_freqs.size());
+		for (const auto& [word, term_freq] : parsed.word_freqs) {
+			parsed.term_freqs.push_back({ terms_->Find(word), term_freq });
+		}
+		std::sort(parsed.term_freqs.begin(), parsed.term_freqs.end(), [](const TermFrequency& lhs, const TermFrequency& rhs) {
+			return lhs.term_id < rhs.term_id;
+			});
 		});
+
+	// 3.        ,      ;
+	// id    ,     end()
+	if (documents.empty()) {
+		return;
+	}
+	std::vector<SegmentDocument> segment_documents;
+	segment_documents.reserve(documents.size());
+	for (const size_t index : order) {
+		const DocumentToAdd& document = documents[index];
+		segment_documents.push_back({ document.id, ComputeAverageRating(document.ratings), document.status,
+			std::move(parsed_documents[index].term_freqs), parsed_documents[index].word_count });
+	}
+
+	const auto index = LoadIndex();
+	auto segments = index->segments;
+	segments.push_back({ std::make_shared<const IndexSegment>(policy, segment_documents), nullptr });
+	// id   ,     
+	const size_t old_document_count = document_ids_.size();
+	for (const SegmentDocument& document : segment_documents) {
+		document_ids_.push_back(document.document_id);
+	}
+	std::inplace_merge(document_ids_.begin(), document_ids_.begin() + old_document_count, document_ids_.end());
+	Publish(std::move(segments), index->write_buffer, true);
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus status, size_t top_count) const {
+	return FindTopDocumentsWithStatus(std::execution::par, raw_query, status, top_count);
 }
 
 
@@ -52,20 +181,54 @@ std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query)
 	return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
 }
 
-std::vector<Document> SearchServer::FindTopDocuments(std::execution::sequenced_policy policy, std::string_view raw_query, DocumentStatus status) const {
-	return FindTopDocuments(raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-		return document_status == status;
-		});
+std::vector<Document> SearchServer::FindTopDocuments(std::execution::sequenced_policy policy, std::string_view raw_query, DocumentStatus status, size_t top_count) const {
+	return FindTopDocumentsWithStatus(policy, raw_query, status, top_count);
 }
 
 std::vector<Document> SearchServer::FindTopDocuments(std::execution::sequenced_policy policy, std::string_view raw_query) const {
-	return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
+	return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
 }
 
-std::vector<Document> SearchServer::FindTopDocuments(std::execution::parallel_policy policy, std::string_view raw_query, DocumentStatus status) const {
-	return FindTopDocuments(policy, raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-		return document_status == status;
-		});
+std::vector<Document> SearchServer::FindTopDocuments(std::execution::parallel_policy policy, std::string_view raw_query, DocumentStatus status, size_t top_count) const {
+	return FindTopDocumentsWithStatus(policy, raw_query, status, top_count);
+}
+
+template <typename Polity>
+std::vector<Document> SearchServer::FindTopDocumentsWithStatus(Polity polity, std::string_view raw_query, DocumentStatus status, size_t top_count) const {
+	const auto index = LoadIndex();
+	const auto context = ScratchLease<QueryContext>::Acquire();
+	ParseQuery(*index, raw_query, true, *context);
+	const StatusIs predicate{ status };
+	if (!query_cache_) {
+		FindTopQueryDocuments(polity, *index, *context, predicate, top_count);
+		return context->matched_documents;
+	}
+
+	// ,  ,    ,   
+	const QueryCache::Key key{ context->query.plus_terms, context->query.minus_terms, status, top_count };
+	if (auto cached_documents = query_cache_->Find(key, index->generation)) {
+		return std::move(*cached_documents);
+	}
+	FindTopQueryDocuments(polity, *index, *context, predicate, top_count);
+	query_cache_->Insert(key, context->matched_documents, index->generation);
+	return context->matched_documents;
+}
+
+void SearchServer::SetQueryCacheCapacity(size_t capacity) {
+	if (capacity == 0) {
+		query_cache_.reset();
+	}
+	else {
+		query_cache_ = std::make_unique<QueryCache>(capacity);
+	}
+}
+
+QueryCacheStats SearchServer::GetQueryCacheStats() const {
+	return query_cache_ ? query_cache_->GetStats() : QueryCacheStats{};
+}
+
+QueryPruningStats SearchServer::GetQueryPruningStats() const {
+	return { evaluated_posting_count_.load(), skipped_posting_count_.load() };
 }
 
 std::vector<Document> SearchServer::FindTopDocuments(std::execution::parallel_policy policy, std::string_view raw_query) const {
@@ -74,53 +237,103 @@ std::vector<Document> SearchServer::FindTopDocuments(std::execution::parallel_po
 
 
 
+void SearchServer::SelectTopDocuments(std::execution::sequenced_policy policy, std::vector<Document>& documents, size_t top_count) {
+	if (documents.size() > top_count) {
+		std::partial_sort(documents.begin(), documents.begin() + top_count, documents.end(), IsMoreRelevant);
+		documents.resize(top_count);
+	}
+	else {
+		std::sort(documents.begin(), documents.end(), IsMoreRelevant);
+	}
+}
+
+void SearchServer::SelectTopDocuments(std::execution::parallel_policy policy, std::vector<Document>& documents, size_t top_count) {
+	const size_t chunk_count = std::max(1u, std::thread::hardware_concurrency());
+
+	//         
+	if (chunk_count == 1 || documents.size() < PARALLEL_TOP_MIN_DOCUMENTS || documents.size() <= top_count * chunk_count) {
+		SelectTopDocuments(std::execution::seq, documents, top_count);
+		return;
+	}
+
+	//     top_count ,      top
+	const size_t chunk_size = (documents.size() + chunk_count - 1) / chunk_count;
+	std::vector<size_t> chunk_begins;
+	for (size_t begin = 0; begin < documents.size(); begin += chunk_size) {
+		chunk_begins.push_back(begin);
+	}
+
+	std::for_each(policy, chunk_begins.begin(), chunk_begins.end(), [&](size_t begin) {
+		const auto first = documents.begin() + begin;
+		const auto last = documents.begin() + std::min(begin + chunk_size, documents.size());
+		std::partial_sort(first, first + std::min<size_t>(top_count, last - first), last, IsMoreRelevant);
+		});
+
+	std::vector<Document> candidates;
+	candidates.reserve(top_count * chunk_begins.size());
+	for (const size_t begin : chunk_begins) {
+		const auto first = documents.begin() + begin;
+		candidates.insert(candidates.end(), first, first + std::min(top_count, documents.size() - begin));
+	}
+
+	SelectTopDocuments(std::execution::seq, candidates, top_count);
+	// documents    ,      
+	documents.assign(candidates.begin(), candidates.end());
+}
+
+
+
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::string_view raw_query,
 	int document_id) const {
-	const auto query = ParseQuery(raw_query, true);
+	const auto index = LoadIndex();
+	const auto context = ScratchLease<QueryContext>::Acquire();
+	ParseQuery(*index, raw_query, true, *context);
+	const Query& query = context->query;
+	const auto location = index->FindDocument(document_id);
+	if (location.ordinal == IndexSegment::NO_ORDINAL) {
+		throw std::out_of_range("Document " + std::to_string(document_id) + " not found");
+	}
+	const SegmentDocument* buffered = location.is_buffered ? &index->write_buffer.buffer->GetDocument(location.ordinal) : nullptr;
+	const IndexSegment* segment = location.is_buffered ? nullptr : index->segments[location.segment_index].segment.get();
+	const auto document_terms = segment ? segment->GetLocalTerms(location.ordinal) : std::span<const TermFrequency>();
+	//   ,    -  
+	const auto contains = [&](const TermId term_id) {
+		if (buffered) {
+			return FindTermFrequency(*buffered, term_id) > 0.0;
+		}
+		const size_t local_term = segment->FindLocalTerm(term_id);
+		return local_term != IndexSegment::NO_LOCAL_TERM && std::binary_search(document_terms.begin(), document_terms.end(),
+			TermFrequency{ static_cast<TermId>(local_term), 0.0 }, [](const TermFrequency& lhs, const TermFrequency& rhs) {
+				return lhs.term_id < rhs.term_id;
+			});
+	};
+	const DocumentStatus status = buffered ? buffered->status : segment->GetStatus(location.ordinal);
 
 	std::vector<std::string_view> matched_words;
 
-	if (std::any_of(query.minus_words.begin(), query.minus_words.end(), [&](const std::string_view word) {
-		return	word_to_document_freqs_.at(word).count(document_id);
-		})) {
-		return { matched_words,documents_.at(document_id).status };
+	if (std::any_of(query.minus_terms.begin(), query.minus_terms.end(), contains)) {
+		return { matched_words, status };
 	}
 
-	for (const std::string_view word : query.plus_words) {
-
-		if (!word_to_document_freqs_.count(word))  continue;
+	for (const TermId term_id : query.plus_terms) {
 
-		if (word_to_document_freqs_.at(word).count(document_id)) {
+		if (contains(term_id)) {
 
-			matched_words.push_back(word);
+			matched_words.push_back(index->terms->GetTerm(term_id));
 
 		}
 
 	}
-	return { matched_words, documents_.at(document_id).status };
+	std::sort(matched_words.begin(), matched_words.end());
+	return { matched_words, status };
 }
 
 
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::parallel_policy polity, std::string_view raw_query,
 
 	int document_id) const {
-	const auto query = ParseQuery(raw_query, false);
-	std::vector<std::string_view> matched_words(query.plus_words.size());
-
-	if (std::any_of(query.minus_words.begin(), query.minus_words.end(), [&](const std::string_view word) {
-		return	word_to_document_freqs_.at(word).count(document_id);
-		})) {
-		matched_words.clear();
-		return { matched_words, documents_.at(document_id).status };
-	}
-
-	const  auto it = std::copy_if(query.plus_words.begin(), query.plus_words.end(), matched_words.begin(), [&](const std::string_view word) {
-		return word_to_document_freqs_.at(word).count(document_id);
-		});
-	matched_words.erase(it, matched_words.end());
-	std::sort(matched_words.begin(), matched_words.end());
-	matched_words.erase(std::unique(matched_words.begin(), matched_words.end()), matched_words.end());
-	return { matched_words, documents_.at(document_id).status };
+	//      ,        
+	return MatchDocument(raw_query, document_id);
 }
 
 
@@ -132,13 +345,56 @@ std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDoc
 
 
 int SearchServer::GetDocumentCount() const {
-	return documents_.size();
+	return static_cast<int>(LoadIndex()->document_count);
+}
+
+
+
+bool SearchServer::IsPruningProfitable(const SegmentQuery& query, size_t top_count) {
+	size_t posting_count = 0;
+	for (const auto& [postings, inverse_document_freq] : query.plus_postings) {
+		posting_count += postings.size();
+	}
+	return top_count < posting_count / PRUNING_POSTING_RATIO;
+}
+
+bool SearchServer::IsDenseAccumulationProfitable(const IndexSegment& segment, const SegmentQuery& query) {
+	size_t touched_postings = 0;
+	for (const auto& [postings, inverse_document_freq] : query.plus_postings) {
+		touched_postings += postings.size();
+	}
+	for (const auto& postings : query.minus_postings) {
+		touched_postings += postings.size();
+	}
+	return touched_postings > 0 && segment.GetDocumentCount() <= touched_postings * DENSE_ACCUMULATOR_RATIO;
+}
+
+
+
+void SearchServer::ResolveQuery(const IndexSegment& segment, const Query& query, const std::vector<double>& inverse_document_freqs,
+	SegmentQuery& segment_query) {
+	segment_query.plus_postings.clear();
+	segment_query.plus_upper_bounds.clear();
+	segment_query.minus_postings.clear();
+	for (size_t i = 0; i < query.plus_terms.size(); ++i) {
+		const size_t local_term = segment.FindLocalTerm(query.plus_terms[i]);
+		if (local_term != IndexSegment::NO_LOCAL_TERM) {
+			segment_query.plus_postings.push_back({ segment.GetPostings().Find(local_term), inverse_document_freqs[i] });
+			segment_query.plus_upper_bounds.push_back(segment.GetMaxTermFrequency(local_term) * inverse_document_freqs[i]);
+		}
+	}
+	for (const TermId term_id : query.minus_terms) {
+		const size_t local_term = segment.FindLocalTerm(term_id);
+		if (local_term != IndexSegment::NO_LOCAL_TERM) {
+			segment_query.minus_postings.push_back(segment.GetPostings().Find(local_term));
+		}
+	}
 }
 
 
 
 bool SearchServer::IsStopWord(const std::string_view word) const {
-	return stop_words_.count(word) > 0;
+	return stop_words_.Contains(word);
 }
 
 
@@ -153,18 +409,14 @@ bool SearchServer::IsValidWord(const std::string_view word) {
 
 
 
-std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(const std::string_view text) const { 
-	std::vector<std::string_view> temp = SplitIntoWords(text);
-	std::vector<std::string_view> words;
-	for (const std::string_view word : temp) {
-		if (!IsValidWord(word)) {
-			throw std::invalid_argument("Word " + std::string(word) + " is invalid");
-		}
-		if (!IsStopWord(word)) {
-			words.push_back(word);
-		}
+void SearchServer::SplitIntoWordsNoStop(const std::string_view text, std::vector<std::string_view>& words) const { 
+	const size_t invalid_word = SplitIntoWords(text, words);
+	if (invalid_word != WORDS_ARE_VALID) {
+		throw std::invalid_argument("Word " + std::string(words[invalid_word]) + " is invalid");
 	}
-	return words;
+	words.erase(std::remove_if(words.begin(), words.end(), [this](std::string_view word) {
+		return IsStopWord(word);
+		}), words.end());
 }
 
 
@@ -179,7 +431,7 @@ int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
 
 
 
-SearchServer::QueryWord SearchServer::ParseQueryWord(const std::string_view text) const {
+SearchServer::QueryWord SearchServer::ParseQueryWord(const std::string_view text, bool is_valid) const {
 	if (text.empty()) {
 		throw std::invalid_argument("Query word is empty");
 	}
@@ -192,7 +444,7 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(const std::string_view text
 		word = word.substr(1);
 	}
 
-	if (word.empty() || word[0] == '-' || !IsValidWord(word)) {
+	if (word.empty() || word[0] == '-' || !is_valid) {
 		throw std::invalid_argument("Query word " + std::string(text) + " is invalid");
 	}
 
@@ -201,8 +453,134 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(const std::string_view text
 
 
 
-double SearchServer::ComputeWordInverseDocumentFreq(const std::string_view word) const {
-	return log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+double SearchServer::ComputeWordInverseDocumentFreq(const IndexSnapshot& index, TermId term_id) {
+	// log(N / df); log N    
+	const size_t document_freq = index.GetDocumentFrequency(term_id);
+	return document_freq > 0 ? index.log_document_count - log(static_cast<double>(document_freq)) : 0.0;
+}
+
+void SearchServer::Publish(std::vector<SegmentState> segments, WriteBufferState write_buffer, bool changes_documents) {
+	const auto previous = LoadIndex();
+	auto index = std::make_shared<IndexSnapshot>();
+	index->terms = terms_;
+	index->segments = std::move(segments);
+	index->write_buffer = std::move(write_buffer);
+	index->document_count = index->write_buffer.GetLiveDocumentCount();
+	for (const SegmentState& state : index->segments) {
+		index->document_count += state.GetLiveDocumentCount();
+	}
+	index->log_document_count = index->document_count > 0 ? log(static_cast<double>(index->document_count)) : 0.0;
+	//       :     ,      
+	index->generation = previous->generation + (changes_documents ? 1 : 0);
+	const bool needs_merge = !SelectSegmentsToMerge(index->segments).empty();
+	index_.store(std::move(index), std::memory_order_release);
+	if (needs_merge) {
+		RequestMerge();
+	}
+}
+
+std::shared_ptr<const IndexSnapshot> SearchServer::LoadIndex() const {
+	return index_.load(std::memory_order_acquire);
+}
+
+SearchServer::~SearchServer() {
+	{
+		std::lock_guard guard(merge_mutex_);
+		stop_merging_ = true;
+	}
+	merge_condition_.notify_all();
+	if (merge_thread_.joinable()) {
+		merge_thread_.join();
+	}
+}
+
+void SearchServer::RequestMerge() {
+	{
+		std::lock_guard guard(merge_mutex_);
+		merge_requested_ = true;
+		if (!merge_thread_.joinable()) {
+			merge_thread_ = std::thread([this] {
+				RunBackgroundMerges();
+				});
+		}
+	}
+	merge_condition_.notify_all();
+}
+
+void SearchServer::WaitForBackgroundMerges() {
+	std::unique_lock lock(merge_mutex_);
+	merge_condition_.wait(lock, [this] {
+		return !merge_requested_ && !merging_;
+		});
+}
+
+void SearchServer::RunBackgroundMerges() {
+	std::unique_lock lock(merge_mutex_);
+	for (;;) {
+		merge_condition_.wait(lock, [this] {
+			return merge_requested_ || stop_merging_;
+			});
+		if (stop_merging_) {
+			return;
+		}
+		merge_requested_ = false;
+		merging_ = true;
+		lock.unlock();
+		while (!stop_merging_ && MergeOnce()) {
+		}
+		lock.lock();
+		merging_ = false;
+		merge_condition_.notify_all();
+	}
+}
+
+bool SearchServer::MergeOnce() {
+	LOG_DURATION("SearchServer::MergeOnce");
+	//   -  -   ,        
+	const auto index = LoadIndex();
+	const auto selected = SelectSegmentsToMerge(index->segments);
+	if (selected.empty()) {
+		return false;
+	}
+	std::vector<SegmentState> inputs;
+	for (const size_t segment_index : selected) {
+		inputs.push_back(index->segments[segment_index]);
+	}
+	SegmentState merged = MergeSegments(inputs);
+
+	std::lock_guard guard(write_mutex_);
+	const auto current = LoadIndex();
+	auto segments = current->segments;
+	std::vector<size_t> positions;
+	for (const SegmentState& input : inputs) {
+		const auto it = std::find_if(segments.begin(), segments.end(), [&input](const SegmentState& state) {
+			return state.segment == input.segment;
+			});
+		if (it == segments.end()) {
+			//      (CompactIndex    ),   
+			return true;
+		}
+		positions.push_back(it - segments.begin());
+
+		// ,    ,    
+		if (it->deletions != input.deletions) {
+			const IndexSegment& segment = *input.segment;
+			for (int ordinal = 0; ordinal < static_cast<int>(segment.GetDocumentCount()); ++ordinal) {
+				if (merged.segment && it->IsDeleted(ordinal) && !input.IsDeleted(ordinal)) {
+					merged = RemoveFromSegment(merged, merged.segment->FindOrdinal(segment.GetDocumentId(ordinal)));
+				}
+			}
+		}
+	}
+	std::sort(positions.rbegin(), positions.rend());
+	for (const size_t position : positions) {
+		segments.erase(segments.begin() + position);
+	}
+	if (merged.segment) {
+		segments.push_back(std::move(merged));
+	}
+	Publish(std::move(segments), current->write_buffer, false);
+	return true;
 }
 
 
@@ -211,44 +589,103 @@ double SearchServer::ComputeWordInverseDocumentFreq(const std::string_view word)
 
 
 
-std::set<int>::iterator SearchServer::begin() const {
+std::vector<int>::const_iterator SearchServer::begin() const {
 	return document_ids_.begin();
 }
 
 
 
-std::set<int>::iterator SearchServer::end() const {
+std::vector<int>::const_iterator SearchServer::end() const {
 	return document_ids_.end();
 }
 
+bool SearchServer::HasDocumentId(int document_id) const {
+	return std::binary_search(document_ids_.begin(), document_ids_.end(), document_id);
+}
 
 
-const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-	return get_document_freqs.at(document_id);
+
+std::map<std::string_view, double> SearchServer::GetWordFrequencies(int document_id) const {
+	const auto index = LoadIndex();
+	const auto location = index->FindDocument(document_id);
+	if (location.ordinal == IndexSegment::NO_ORDINAL) {
+		throw std::out_of_range("Document " + std::to_string(document_id) + " not found");
+	}
+	std::map<std::string_view, double> word_freqs;
+	if (location.is_buffered) {
+		for (const auto& [term_id, term_freq] : index->write_buffer.buffer->GetDocument(location.ordinal).term_freqs) {
+			word_freqs.emplace(index->terms->GetTerm(term_id), term_freq);
+		}
+	}
+	else {
+		const IndexSegment& segment = *index->segments[location.segment_index].segment;
+		for (const auto [local_term, term_freq] : segment.GetLocalTerms(location.ordinal)) {
+			word_freqs.emplace(index->terms->GetTerm(segment.GetTerm(local_term)), term_freq);
+		}
+	}
+	return word_freqs;
+}
+
+
+
+std::vector<TermFrequency> SearchServer::GetDocumentTerms(int document_id) const {
+	const auto index = LoadIndex();
+	const auto location = index->FindDocument(document_id);
+	if (location.ordinal == IndexSegment::NO_ORDINAL) {
+		throw std::out_of_range("Document " + std::to_string(document_id) + " not found");
+	}
+	if (location.is_buffered) {
+		return index->write_buffer.buffer->GetDocument(location.ordinal).term_freqs;
+	}
+	const IndexSegment& segment = *index->segments[location.segment_index].segment;
+	std::vector<TermFrequency> term_freqs;
+	for (const auto [local_term, term_freq] : segment.GetLocalTerms(location.ordinal)) {
+		term_freqs.push_back({ segment.GetTerm(local_term), term_freq });
+	}
+	return term_freqs;
+}
+
+
+
+const TermDictionary& SearchServer::GetTermDictionary() const {
+	return *terms_;
 }
 
 
 
 void SearchServer::RemoveDocument(int document_id) {
-	documents_.erase(document_id);
-	document_ids_.erase(document_id);
-	auto it = get_document_freqs.find(document_id); // it -   int    
-	for (auto& k : (*it).second) word_to_document_freqs_.at(k.first).erase(document_id); //   word_to_document_freqs_ (  string) 
-	this->get_document_freqs.erase(it); //   get_document_freqs (  id) 
+	LOG_DURATION("SearchServer::RemoveDocument");
+	std::lock_guard guard(write_mutex_);
+	const auto id_position = std::lower_bound(document_ids_.begin(), document_ids_.end(), document_id);
+	if (id_position == document_ids_.end() || *id_position != document_id) {
+		return;
+	}
+	document_ids_.erase(id_position);
+	const auto index = LoadIndex();
+	const auto location = index->FindDocument(document_id);
+	if (location.is_buffered) {
+		//    ,       
+		WriteBufferState write_buffer = index->write_buffer;
+		write_buffer.deleted |= uint64_t{ 1 } << location.ordinal;
+		Publish(index->segments, std::move(write_buffer), true);
+		return;
+	}
+
+	//   ,        ;
+	//        
+	auto segments = index->segments;
+	SegmentState& state = segments[location.segment_index];
+	state = RemoveFromSegment(state, location.ordinal);
+	if (!state.segment) {
+		segments.erase(segments.begin() + location.segment_index);
+	}
+	Publish(std::move(segments), index->write_buffer, true);
 }
 
 
 void SearchServer::RemoveDocument(const std::execution::parallel_policy policy, int document_id) {
-	std::vector<const std::string_view*> helper(get_document_freqs.at(document_id).size()); //    
-	std::transform(policy, get_document_freqs.at(document_id).begin(), get_document_freqs.at(document_id).end(), helper.begin(), [](const auto& m) {
-		return &m.first;
-		});
-	std::for_each(policy, helper.begin(), helper.end(), [&](const auto& help) {
-		word_to_document_freqs_.at(*help).erase(document_id);
-		});
-	get_document_freqs.erase(document_id);
-	documents_.erase(document_id);
-	document_ids_.erase(document_id);
+	//       ,     
+	RemoveDocument(document_id);
 }
 
 void SearchServer::RemoveDocument(const std::execution::sequenced_policy policy, int document_id) {
@@ -257,28 +694,261 @@ void SearchServer::RemoveDocument(const std::execution::sequenced_policy policy,
 
 
 
+void SearchServer::CompactIndex() {
+	LOG_DURATION("SearchServer::CompactIndex");
+	std::lock_guard guard(write_mutex_);
+	const auto index = LoadIndex();
+
+	//      ,     ,
+	//      .   ,    
+	std::vector<TermId> new_term_ids(terms_->size(), NO_TERM);
+	auto new_terms = std::make_shared<TermDictionary>();
+	for (TermId term_id = 0; term_id < terms_->size(); ++term_id) {
+		if (index->GetDocumentFrequency(term_id) > 0) {
+			new_term_ids[term_id] = new_terms->Intern(terms_->GetTerm(term_id));
+		}
+	}
+
+	//       
+	std::vector<SegmentState> inputs = index->segments;
+	SegmentState frozen = FreezeWriteBuffer(index->write_buffer);
+	if (frozen.segment) {
+		inputs.push_back(std::move(frozen));
+	}
+	std::vector<SegmentState> segments;
+	SegmentState merged = MergeSegments(inputs, new_term_ids);
+	if (merged.segment) {
+		segments.push_back(std::move(merged));
+	}
+	write_buffer_ = std::make_shared<WriteBuffer>();
+	terms_ = std::move(new_terms);
+	Publish(std::move(segments), {}, true);
+}
 
 
-SearchServer::Query SearchServer::ParseQuery(const std::string_view text, const bool is_sequenced) const {
-	Query result;
-	for (const std::string_view word : SplitIntoWords(text)) {
-		const auto query_word = ParseQueryWord(word);
+
+IndexMemoryStats SearchServer::GetMemoryStats() const {
+	const auto index = LoadIndex();
+	const TermDictionary& terms = *index->terms;
+	IndexMemoryStats stats;
+	stats.document_count = index->document_count;
+	stats.term_count = terms.size();
+	stats.dictionary_bytes = terms.GetAllocatedBytes();
+	stats.segment_count = index->segments.size();
+	stats.buffered_document_count = index->write_buffer.GetLiveDocumentCount();
+
+	std::vector<size_t> document_freqs(stats.term_count, 0);
+	//    :    ,    
+	const WriteBufferState& write_buffer = index->write_buffer;
+	for (int ordinal = 0; ordinal < write_buffer.document_count; ++ordinal) {
+		const auto& term_freqs = write_buffer.buffer->GetDocument(ordinal).term_freqs;
+		if (write_buffer.IsDeleted(ordinal)) {
+			stats.removed_posting_count += term_freqs.size();
+			continue;
+		}
+		stats.posting_count += term_freqs.size();
+		for (const auto& [term_id, term_freq] : term_freqs) {
+			++document_freqs[term_id];
+		}
+	}
+	for (const SegmentState& state : index->segments) {
+		const IndexSegment& segment = *state.segment;
+		const size_t removed_posting_count = state.deletions ? state.deletions->GetPostingCount() : 0;
+		const size_t segment_posting_count = segment.GetPostings().GetPostingCount();
+		stats.posting_count += segment_posting_count - removed_posting_count;
+		stats.removed_posting_count += removed_posting_count;
+		stats.posting_bytes += segment.GetAllocatedBytes();
+		//   ,        
+		if (segment_posting_count > 0) {
+			stats.reclaimable_posting_bytes += segment.GetPostings().GetCompressedBytes() * removed_posting_count / segment_posting_count;
+		}
+		stats.mapped_posting_bytes += segment.GetPostings().GetMappedBytes();
+		stats.mapped_document_bytes += segment.GetMappedBytes();
+		for (size_t local_term = 0; local_term < segment.GetTermCount(); ++local_term) {
+			document_freqs[segment.GetTerm(local_term)] += state.GetDocumentFrequency(local_term);
+		}
+	}
+	for (TermId term_id = 0; term_id < stats.term_count; ++term_id) {
+		if (document_freqs[term_id] == 0) {
+			++stats.empty_term_count;
+			stats.reclaimable_dictionary_bytes += terms.GetTerm(term_id).size();
+		}
+	}
+	return stats;
+}
+
+
+
+
+void SearchServer::SaveSnapshot(const std::string& path) const {
+	LOG_DURATION("SearchServer::SaveSnapshot");
+	const auto index = LoadIndex();
+	//       ,      
+	SegmentState state;
+	if (index->segments.size() == 1 && !index->segments.front().deletions && index->write_buffer.GetLiveDocumentCount() == 0) {
+		state = index->segments.front();
+	}
+	else {
+		std::vector<SegmentState> inputs = index->segments;
+		SegmentState frozen = FreezeWriteBuffer(index->write_buffer);
+		if (frozen.segment) {
+			inputs.push_back(std::move(frozen));
+		}
+		state = MergeSegments(inputs);
+	}
+	const IndexSegment* segment = state.segment.get();
+
+	SnapshotWriter writer(path);
+	writer.WriteStrings(SnapshotSection::STOP_WORD_OFFSETS, SnapshotSection::STOP_WORD_CHARS, stop_words_);
+
+	std::vector<std::string_view> terms(index->terms->size());
+	for (TermId term_id = 0; term_id < terms.size(); ++term_id) {
+		terms[term_id] = index->terms->GetTerm(term_id);
+	}
+	writer.WriteStrings(SnapshotSection::TERM_OFFSETS, SnapshotSection::TERM_CHARS, terms);
+
+	//       ; ,   ,  
+	SegmentColumns columns;
+	const uint64_t empty_offsets[1] = { 0 };
+	columns.term_offsets = empty_offsets;
+	std::span<const uint64_t> posting_offsets = empty_offsets;
+	std::span<const uint64_t> block_offsets = empty_offsets;
+	std::span<const PostingBlock> blocks;
+	std::span<const uint32_t> data;
+	std::vector<uint64_t> posting_checksums;
+	if (segment) {
+		const InvertedIndex& postings = segment->GetPostings();
+		postings.CheckLists();
+		columns = segment->GetColumns();
+		posting_offsets = postings.GetOffsets();
+		block_offsets = postings.GetBlockOffsets();
+		blocks = postings.GetBlocks();
+		data = postings.GetData();
+		posting_checksums.reserve(segment->GetTermCount());
+		for (size_t local_term = 0; local_term < segment->GetTermCount(); ++local_term) {
+			posting_checksums.push_back(ComputePostingListChecksum(postings, local_term));
+		}
+	}
+	writer.BeginSection(SnapshotSection::SEGMENT_TERMS);
+	writer.WriteRecords(columns.terms);
+	writer.BeginSection(SnapshotSection::SEGMENT_MAX_TERM_FREQS);
+	writer.WriteRecords(columns.max_term_freqs);
+	writer.BeginSection(SnapshotSection::POSTING_OFFSETS);
+	writer.WriteRecords(posting_offsets);
+	writer.BeginSection(SnapshotSection::POSTING_BLOCK_OFFSETS);
+	writer.WriteRecords(block_offsets);
+	writer.BeginSection(SnapshotSection::POSTING_CHECKSUMS);
+	writer.WriteRecords(posting_checksums);
+	writer.BeginSection(SnapshotSection::POSTING_BLOCKS);
+	writer.WriteRecords(blocks);
+	writer.BeginSection(SnapshotSection::POSTING_DATA);
+	writer.WriteRecords(data);
+	writer.BeginSection(SnapshotSection::DOCUMENT_IDS);
+	writer.WriteRecords(columns.document_ids);
+	writer.BeginSection(SnapshotSection::DOCUMENT_RATINGS);
+	writer.WriteRecords(columns.ratings);
+	writer.BeginSection(SnapshotSection::DOCUMENT_STATUSES);
+	writer.WriteRecords(columns.statuses);
+	writer.BeginSection(SnapshotSection::DOCUMENT_STATUS_BITMAPS);
+	writer.WriteRecords(columns.status_bitmaps);
+	writer.BeginSection(SnapshotSection::DOCUMENT_WORD_COUNTS);
+	writer.WriteRecords(columns.word_counts);
+	writer.BeginSection(SnapshotSection::DOCUMENT_INVERSE_WORD_COUNTS);
+	writer.WriteRecords(columns.inverse_word_counts);
+	writer.BeginSection(SnapshotSection::DOCUMENT_TERM_OFFSETS);
+	writer.WriteRecords(columns.term_offsets);
+	writer.BeginSection(SnapshotSection::DOCUMENT_TERMS);
+	writer.WriteRecords(columns.term_freqs);
+	writer.Finish();
+}
+
+SearchServer SearchServer::LoadSnapshot(const std::string& path) {
+	LOG_DURATION("SearchServer::LoadSnapshot");
+	return SearchServer(SnapshotReader(std::make_shared<const MappedFile>(path)));
+}
+
+SearchServer::SearchServer(const SnapshotReader& reader)
+	: SearchServer(reader.GetStrings(SnapshotSection::STOP_WORD_OFFSETS, SnapshotSection::STOP_WORD_CHARS)) {
+	snapshot_ = reader.GetFile();
+
+	const auto terms = reader.GetStrings(SnapshotSection::TERM_OFFSETS, SnapshotSection::TERM_CHARS);
+	terms_->Reserve(terms.size());
+	for (const std::string_view term : terms) {
+		if (terms_->InternExternal(term) + 1 != terms_->size()) {
+			throw std::invalid_argument("Invalid snapshot: duplicate term");
+		}
+	}
+
+	//       :    ,    
+	//    .          
+	SegmentColumns columns;
+	columns.terms = reader.GetSection<TermId>(SnapshotSection::SEGMENT_TERMS);
+	columns.max_term_freqs = reader.GetSection<double>(SnapshotSection::SEGMENT_MAX_TERM_FREQS);
+	columns.document_ids = reader.GetSection<int>(SnapshotSection::DOCUMENT_IDS);
+	columns.ratings = reader.GetSection<int>(SnapshotSection::DOCUMENT_RATINGS);
+	columns.statuses = reader.GetSection<DocumentStatus>(SnapshotSection::DOCUMENT_STATUSES);
+	columns.status_bitmaps = reader.GetSection<uint64_t>(SnapshotSection::DOCUMENT_STATUS_BITMAPS);
+	columns.word_counts = reader.GetSection<int>(SnapshotSection::DOCUMENT_WORD_COUNTS);
+	columns.inverse_word_counts = reader.GetSection<double>(SnapshotSection::DOCUMENT_INVERSE_WORD_COUNTS);
+	columns.term_offsets = reader.GetSection<uint64_t>(SnapshotSection::DOCUMENT_TERM_OFFSETS);
+	columns.term_freqs = reader.GetSection<TermFrequency>(SnapshotSection::DOCUMENT_TERMS);
+	CheckSnapshotColumns(columns, terms.size());
+
+	const auto posting_checksums = reader.GetSection<uint64_t>(SnapshotSection::POSTING_CHECKSUMS);
+	const size_t document_count = columns.document_ids.size();
+	InvertedIndex postings(reader.GetSection<uint64_t>(SnapshotSection::POSTING_OFFSETS),
+		reader.GetSection<uint64_t>(SnapshotSection::POSTING_BLOCK_OFFSETS),
+		reader.GetUncheckedSection<PostingBlock>(SnapshotSection::POSTING_BLOCKS),
+		reader.GetUncheckedSection<uint32_t>(SnapshotSection::POSTING_DATA),
+		[posting_checksums, document_count](const InvertedIndex& index, size_t term) {
+			CheckSnapshotPostingList(index, term, document_count, posting_checksums[term]);
+		});
+	if (postings.GetOffsets().size() != columns.terms.size() + 1 || posting_checksums.size() != columns.terms.size()) {
+		throw std::invalid_argument("Invalid snapshot: bad offsets");
+	}
+	CheckSnapshotPostingOffsets(postings);
+	if (columns.term_freqs.size() != postings.GetPostingCount()) {
+		throw std::invalid_argument("Invalid snapshot: index size mismatch");
+	}
+
+	std::vector<SegmentState> segments;
+	if (document_count > 0) {
+		segments.push_back({ std::make_shared<const IndexSegment>(columns, std::move(postings)), nullptr });
+	}
+	document_ids_.assign(columns.document_ids.begin(), columns.document_ids.end());
+	Publish(std::move(segments), {}, true);
+}
+
+void SearchServer::ParseQuery(const IndexSnapshot& index, const std::string_view text, const bool is_sequenced, QueryContext& context) const {
+	LOG_DURATION("SearchServer::ParseQuery");
+	Query& result = context.query;
+	result.plus_terms.clear();
+	result.minus_terms.clear();
+	std::vector<std::string_view>& words = context.words;
+	const size_t invalid_word = SplitIntoWords(text, words);
+	for (size_t i = 0; i < words.size(); ++i) {
+		const auto query_word = ParseQueryWord(words[i], i != invalid_word);
 
 		if (!query_word.is_stop) {
+			// ,      ,    
+			const TermId term_id = index.terms->Find(query_word.data);
+			if (term_id == NO_TERM) {
+				continue;
+			}
+
 			if (query_word.is_minus) {
-				result.minus_words.push_back(query_word.data);
+				result.minus_terms.push_back(term_id);
 			}
 
 			else {
-				result.plus_words.push_back(query_word.data);
+				result.plus_terms.push_back(term_id);
 			}
 		}
 	}
 	if (is_sequenced) {
-		std::sort(std::execution::par, result.plus_words.begin(), result.plus_words.end());
-		std::sort(std::execution::par, result.minus_words.begin(), result.minus_words.end());
-		result.plus_words.erase(std::unique(result.plus_words.begin(), result.plus_words.end()), result.plus_words.end());
-		result.minus_words.erase(std::unique(result.minus_words.begin(), result.minus_words.end()), result.minus_words.end());
+		std::sort(result.plus_terms.begin(), result.plus_terms.end());
+		std::sort(result.minus_terms.begin(), result.minus_terms.end());
+		result.plus_terms.erase(std::unique(result.plus_terms.begin(), result.plus_terms.end()), result.plus_terms.end());
+		result.minus_terms.erase(std::unique(result.minus_terms.begin(), result.minus_terms.end()), result.minus_terms.end());
 	}
-	return result;
 }
\ No newline at end of file
@@ -2,19 +2,77 @@
 #include "document.h" 
 #include "string_processing.h" 
 #include "concurrent_map.h"
+#include "index_snapshot.h"
+#include "term_dictionary.h"
+#include "dense_accumulator.h"
+#include "document_predicates.h"
+#include "exclusion_set.h"
+#include "stop_word_set.h"
+#include "query_cache.h"
+#include "thread_scratch.h"
 #include "log_duration.h"
+#include <atomic>
+#include <condition_variable>
 #include <map> 
+#include <memory>
+#include <mutex>
 #include <set> 
 #include <algorithm> 
 #include<cmath> 
 #include <stdexcept> 
 #include <execution>
 #include <compare>
-#include <deque>
+#include <numeric>
+#include <limits>
+#include <tuple>
+#include <span>
+#include <thread>
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
+const size_t PARALLEL_TOP_MIN_DOCUMENTS = 10000;
+const size_t RELEVANCE_MAP_BUCKET_COUNT = 128;
+// плотный накопитель выбирается, если сегмент не больше чем в DENSE_ACCUMULATOR_RATIO раз превышает число затронутых постингов
+const size_t DENSE_ACCUMULATOR_RATIO = 8;
+// отсечение по верхним оценкам (MaxScore) включается, если плюс-слова сегмента дают
+// больше чем в PRUNING_POSTING_RATIO раз больше постингов, чем нужно документов
+const size_t PRUNING_POSTING_RATIO = 16;
 const double MAX_RELEVANCE_DIFFERENCE = 1e-6;
 
+// Память индекса; reclaimable_* - сколько освободит CompactIndex
+struct IndexMemoryStats {
+	size_t document_count = 0;
+	size_t term_count = 0;
+	size_t empty_term_count = 0;
+	size_t posting_count = 0;
+	size_t removed_posting_count = 0;
+	size_t posting_bytes = 0;
+	size_t reclaimable_posting_bytes = 0;
+	size_t dictionary_bytes = 0;
+	size_t reclaimable_dictionary_bytes = 0;
+	size_t mapped_posting_bytes = 0; // списки, которые читаются прямо из снимка и не занимают кучу
+	size_t mapped_document_bytes = 0; // столбцы документов и их слова, которые тоже читаются прямо из снимка
+	size_t segment_count = 0;
+	size_t buffered_document_count = 0; // документы в буфере записи, еще не замороженные в сегмент
+};
+
+// постинги плюс-слов, оцененные и пропущенные поиском с отсечением, с момента создания сервера
+struct QueryPruningStats {
+	size_t evaluated_posting_count = 0;
+	size_t skipped_posting_count = 0;
+};
+
+class MappedFile;
+class SnapshotReader;
+
+// Поиск, MatchDocument, GetWordFrequencies, GetDocumentTerms, GetDocumentCount и GetMemoryStats
+// можно вызывать из любых потоков одновременно с изменениями индекса: каждый вызов работает
+// с неизменяемой версией индекса, взятой в начале. Изменения выполняются по одному.
+// begin/end, GetTermDictionary и SetQueryCacheCapacity нельзя вызывать одновременно с изменениями.
+// AddDocument дописывает документ в небольшой буфер, заполненный буфер становится сегментом; сегменты сливает
+// фоновый поток, поэтому время добавления не зависит от размера индекса.
+// Сервер не копируется и не перемещается: в нем мьютексы и атомарный указатель на версию индекса, а фоновый поток
+// слияний держит указатель на сам сервер.
+// LoadSnapshot возвращает сервер по значению без перемещения (обязательный пропуск копии)
 class SearchServer {
 public:
 	template <typename StringContainer>
@@ -23,35 +81,65 @@ public:
 	explicit SearchServer(std::string_view stop_words_text);
 	explicit SearchServer() = default;
 
+	SearchServer(const SearchServer&) = delete;
+	SearchServer& operator=(const SearchServer&) = delete;
+
+	~SearchServer();
+
 	void AddDocument(int document_id, std::string_view document, DocumentStatus status,
 		const std::vector<int>& ratings);
 
+	// Пакетное добавление: разбор документов и построение списков слов идут параллельно.
+	// Проверки те же, что в AddDocument; при ошибке исключение бросается до изменения индекса
+	void AddDocuments(const std::vector<DocumentToAdd>& documents);
+
+	void AddDocuments(std::execution::sequenced_policy policy, const std::vector<DocumentToAdd>& documents);
+
+	void AddDocuments(std::execution::parallel_policy policy, const std::vector<DocumentToAdd>& documents);
+
+	// top_count - сколько лучших документов вернуть
 	template <typename DocumentPredicate>
 	std::vector<Document> FindTopDocuments(std::string_view raw_query,
-		DocumentPredicate document_predicate) const;
+		DocumentPredicate document_predicate, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
-	std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status) const;
+	std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
 	std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
 
-	std::vector<Document> FindTopDocuments(std::execution::sequenced_policy policy, std::string_view raw_query, DocumentStatus status) const;
+	std::vector<Document> FindTopDocuments(std::execution::sequenced_policy policy, std::string_view raw_query, DocumentStatus status, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
 	std::vector<Document> FindTopDocuments(std::execution::sequenced_policy policy, std::string_view raw_query) const;
 
 	template <typename DocumentPredicate, typename Polity>
-	std::vector<Document> FindTopDocuments(Polity polity, std::string_view raw_query, DocumentPredicate document_predicate) const;
+	std::vector<Document> FindTopDocuments(Polity polity, std::string_view raw_query, DocumentPredicate document_predicate, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
-	std::vector<Document> FindTopDocuments(std::execution::parallel_policy polity, std::string_view raw_query, DocumentStatus status) const;
+	// Результат пишется в documents вместо нового вектора. Остальные буферы запроса живут в потоке,
+	// поэтому повторный последовательный запрос с тем же documents не выделяет память
+	template <typename DocumentPredicate, typename Polity>
+	void FindTopDocuments(Polity polity, std::string_view raw_query, DocumentPredicate document_predicate, std::vector<Document>& documents,
+		size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
+	std::vector<Document> FindTopDocuments(std::execution::parallel_policy polity, std::string_view raw_query, DocumentStatus status, size_t top_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
 	std::vector<Document> FindTopDocuments(std::execution::parallel_policy polity, std::string_view raw_query) const;
 
 	int GetDocumentCount() const;
 
-	std::set<int>::iterator begin() const;
+	// id документов по возрастанию. Раньше итератор был std::set<int>::iterator; теперь это итератор вектора,
+	// который становится недействительным при любом добавлении или удалении документа
+	std::vector<int>::const_iterator begin() const;
+
+	std::vector<int>::const_iterator end() const;
 
-	std::set<int>::iterator end() const;
+	// Слова документа с частотами; для неизвестного или удаленного id - out_of_range.
+	// Словарь возвращается по значению: сервер хранит номера слов, а не словари документов. Ключи указывают
+	// в словарь сервера и остаются действительными до CompactIndex
+	std::map<std::string_view, double> GetWordFrequencies(int document_id) const;
 
-	const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+	// номера слов документа по возрастанию с частотами
+	std::vector<TermFrequency> GetDocumentTerms(int document_id) const;
+
+	const TermDictionary& GetTermDictionary() const;
 
 	void RemoveDocument(int documents_id);
 
@@ -59,6 +147,32 @@ public:
 
 	void RemoveDocument(const std::execution::sequenced_policy, int document_id);
 
+	// Удаление только помечает документ в его сегменте, сегмент переписывается по мере накопления удаленных.
+	// CompactIndex сливает все сегменты в один и убирает из словаря слова без документов;
+	// string_view, полученные из GetWordFrequencies и MatchDocument (в том числе в других потоках), после этого недействительны
+	void CompactIndex();
+
+	IndexMemoryStats GetMemoryStats() const;
+
+	// ждет, пока фоновый поток не сольет все, что можно слить
+	void WaitForBackgroundMerges();
+
+	// Кэш результатов FindTopDocuments с фильтром по статусу (запросы с предикатом не кэшируются).
+	// Сбрасывается при добавлении и удалении документов и CompactIndex, фоновые слияния его не трогают; capacity 0 отключает кэш
+	void SetQueryCacheCapacity(size_t capacity);
+
+	QueryCacheStats GetQueryCacheStats() const;
+
+	QueryPruningStats GetQueryPruningStats() const;
+
+	// Снимок: словарь, списки слов, слова документов, рейтинги и статусы в версионированном файле с контрольными суммами.
+	// Индекс сохраняется одним сегментом. LoadSnapshot отображает файл в память; словарь и весь сегмент
+	// используются прямо из него, пока сегмент не будет переписан слиянием. Удаленные документы в снимок не попадают.
+	// Испорченный список слова обнаруживается при первом запросе с этим словом: запрос бросает invalid_argument
+	void SaveSnapshot(const std::string& path) const;
+
+	static SearchServer LoadSnapshot(const std::string& path);
+
 	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query, int document_id) const;
 
 	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::execution::parallel_policy polity, std::string_view raw_query, 	int document_id) const;
@@ -68,178 +182,575 @@ public:
 
 
 private:
-	struct DocumentData {
-		int rating;
-		DocumentStatus status;
-	};
+	const StopWordSet stop_words_;
+
+	std::shared_ptr<TermDictionary> terms_ = std::make_shared<TermDictionary>(); // текст документов не хранится, только различные слова
+
+	// Внешние id по возрастанию; меняется только под write_mutex_. Внутри индекса документы адресуются
+	// плотными порядковыми номерами сегментов, а id нужен только для проверки повторов, обхода и ответа
+	std::vector<int> document_ids_;
+
+	// Текущая версия индекса; читатели атомарно копируют указатель через LoadIndex, писатель подменяет его в Publish
+	std::atomic<std::shared_ptr<const IndexSnapshot>> index_{ std::make_shared<const IndexSnapshot>(terms_) };
+
+	std::mutex write_mutex_;
+
+	std::shared_ptr<WriteBuffer> write_buffer_ = std::make_shared<WriteBuffer>(); // заполняется только под write_mutex_
+
+	// фоновые слияния; флаги под merge_mutex_
+	std::mutex merge_mutex_;
+	std::condition_variable merge_condition_;
+	std::thread merge_thread_;
+	bool merge_requested_ = false;
+	bool merging_ = false;
+	std::atomic<bool> stop_merging_ = false;
+
+	std::shared_ptr<const MappedFile> snapshot_; // держит память, на которую ссылаются словарь и сегмент снимка
 
-	std::deque<std::string> storage;
-	std::map<int, std::map<std::string_view, double>> get_document_freqs; // {id, {document, freqs}}. 
-	std::map<std::string_view, std::map<int, double>> word_to_document_freqs_; // {document, {id, freqs}}. 
+	std::unique_ptr<QueryCache> query_cache_;
 
-	const std::set<std::string, std::less<>> stop_words_;
+	mutable std::atomic<size_t> evaluated_posting_count_ = 0;
+	mutable std::atomic<size_t> skipped_posting_count_ = 0;
 
-	std::map<int, DocumentData> documents_;
+	explicit SearchServer(const SnapshotReader& reader);
 
-	std::set<int> document_ids_; 
+	bool HasDocumentId(int document_id) const;
 
 	bool IsStopWord(const std::string_view word) const;
 
 	static bool IsValidWord(const std::string_view word);
 
-	std::vector<std::string_view> SplitIntoWordsNoStop(const std::string_view text) const;
+	// слова текста без стоп-слов в буфер words; слово с управляющим символом - исключение
+	void SplitIntoWordsNoStop(const std::string_view text, std::vector<std::string_view>& words) const;
 
 	static int ComputeAverageRating(const std::vector<int>& ratings);
 
+	template <typename ExecutionPolicy>
+	void AddDocumentsImpl(ExecutionPolicy policy, const std::vector<DocumentToAdd>& documents);
+
 	struct QueryWord {
 		std::string_view data;
 		bool is_minus;
 		bool is_stop;
 	};
 
-	QueryWord ParseQueryWord(const std::string_view text) const;
+	// is_valid - в слове нет управляющих символов, это проверяет разбиение на слова
+	QueryWord ParseQueryWord(const std::string_view text, bool is_valid) const;
 
+	// слова, которых нет в словаре, в запрос не попадают
 	struct Query {
-		std::vector<std::string_view> plus_words;
-		std::vector<std::string_view> minus_words;
+		std::vector<TermId> plus_terms;
+		std::vector<TermId> minus_terms;
+	};
+
+	struct QueryContext;
+
+	// разбирает запрос в context.query, слова текста - в context.words
+	void ParseQuery(const IndexSnapshot& index, const std::string_view text, const bool is_sequenced, QueryContext& context) const;
+
+	static double ComputeWordInverseDocumentFreq(const IndexSnapshot& index, TermId term_id);
+
+	// публикует новую версию индекса из сегментов и буфера записи; вызывается под write_mutex_.
+	// changes_documents - документы добавлены или удалены, а не только переложены между сегментами
+	void Publish(std::vector<SegmentState> segments, WriteBufferState write_buffer, bool changes_documents);
+
+	std::shared_ptr<const IndexSnapshot> LoadIndex() const;
+
+	void RequestMerge();
+
+	void RunBackgroundMerges();
+
+	// одно слияние; false, если сливать нечего
+	bool MergeOnce();
+
+	// top_count лучших документов разобранного запроса в context.matched_documents
+	template <typename DocumentPredicate, typename Polity>
+	void FindTopQueryDocuments(Polity polity, const IndexSnapshot& index, QueryContext& context, DocumentPredicate document_predicate, size_t top_count) const;
+
+	template <typename Polity>
+	std::vector<Document> FindTopDocumentsWithStatus(Polity polity, std::string_view raw_query, DocumentStatus status, size_t top_count) const;
+
+	// запрос в номерах сегмента: списки плюс-слов с idf и списки минус-слов; слов, которых в сегменте нет, здесь нет.
+	// plus_upper_bounds[i] - наибольший вклад i-го плюс-слова в релевантность документа сегмента
+	struct SegmentQuery {
+		std::vector<std::pair<PostingList, double>> plus_postings;
+		std::vector<double> plus_upper_bounds;
+		std::vector<PostingList> minus_postings;
 	};
 
-	Query ParseQuery(const std::string_view text, const bool is_sequenced) const;
+	// типизированные предикаты проверяются по столбцам сегмента, остальные вызываются с id, статусом и рейтингом
+	template <typename DocumentPredicate>
+	static bool IsAccepted(const IndexSegment& segment, int ordinal, DocumentPredicate& document_predicate) {
+		if constexpr (IsTypedDocumentPredicate<DocumentPredicate>::value) {
+			return MatchesOrdinal(document_predicate, segment, ordinal);
+		}
+		else {
+			return document_predicate(segment.GetDocumentId(ordinal), segment.GetStatus(ordinal), segment.GetRating(ordinal));
+		}
+	}
+
+	static void ResolveQuery(const IndexSegment& segment, const Query& query, const std::vector<double>& inverse_document_freqs,
+		SegmentQuery& segment_query);
+
+	// релевантность top_count-го из уже найденных документов; документ, который не дотягивает до нее
+	// больше чем на MAX_RELEVANCE_DIFFERENCE, в top_count лучших не попадет
+	class RelevanceThreshold {
+	public:
+		// relevances - буфер для кучи лучших релевантностей
+		RelevanceThreshold(size_t top_count, std::vector<double>& relevances)
+			: top_count_(top_count)
+			, relevances_(relevances) {
+			relevances_.clear();
+		}
+
+		void Add(double relevance) {
+			if (relevances_.size() < top_count_) {
+				relevances_.push_back(relevance);
+				std::push_heap(relevances_.begin(), relevances_.end(), std::greater<double>());
+			}
+			else if (top_count_ > 0 && relevance > relevances_.front()) {
+				std::pop_heap(relevances_.begin(), relevances_.end(), std::greater<double>());
+				relevances_.back() = relevance;
+				std::push_heap(relevances_.begin(), relevances_.end(), std::greater<double>());
+			}
+		}
 
-	double ComputeWordInverseDocumentFreq(const std::string_view word) const;
+		// наименьшая релевантность, с которой документ еще может войти в top_count лучших
+		double GetMinRelevance() const {
+			return relevances_.size() < top_count_ || top_count_ == 0
+				? -std::numeric_limits<double>::infinity() : relevances_.front() - MAX_RELEVANCE_DIFFERENCE;
+		}
+
+	private:
+		size_t top_count_;
+		std::vector<double>& relevances_; // куча с наименьшей релевантностью в начале
+	};
+
+	// курсор списка плюс-слова при отсечении по верхним оценкам
+	struct TermCursor {
+		PostingCursor cursor;
+		double inverse_document_freq;
+		double upper_bound;
+	};
 
+	// вклад постинга в релевантность документа при разреженном накоплении
+	struct PostingRelevance {
+		int ordinal;
+		int term_index;
+		double relevance;
+	};
+
+	// Буферы одного запроса. Берутся через ScratchLease и после первых запросов потока уже имеют нужную емкость,
+	// поэтому разбор, поиск по сегментам и отбор лучших в установившемся режиме обходятся без выделений памяти
+	struct QueryContext {
+		std::vector<std::string_view> words;
+		Query query;
+		std::vector<double> inverse_document_freqs;
+		SegmentQuery segment_query;
+		ExclusionSet exclusions;
+		std::vector<double> threshold_relevances;
+		std::vector<TermCursor> term_cursors;
+		std::vector<double> upper_bound_sums;
+		std::vector<PostingRelevance> posting_relevances;
+		std::vector<Document> matched_documents;
+	};
+
+	// документы, которые могут войти в top_count лучших, в context.matched_documents; в сегментах, где это выгодно,
+	// остальные отсекаются по верхним оценкам
+	template <typename DocumentPredicate, typename ExecutionPolicy>
+	void FindAllDocuments(ExecutionPolicy policy, const IndexSnapshot& index, QueryContext& context, DocumentPredicate document_predicate,
+		size_t top_count) const;
+
+	static bool IsPruningProfitable(const SegmentQuery& query, size_t top_count);
+
+	// документы буфера записи оцениваются по их спискам слов и добавляются в context.matched_documents;
+	// возвращает число оцененных постингов
 	template <typename DocumentPredicate>
-	std::vector<Document> FindAllDocuments(const Query& query, DocumentPredicate document_predicate) const;
+	static size_t FindBufferedDocuments(const WriteBufferState& state, QueryContext& context, DocumentPredicate document_predicate,
+		RelevanceThreshold& threshold);
 
+	// MaxScore по сегменту для context.segment_query: документы перебираются по возрастанию номера, добавляются те,
+	// что дотягивают до порога; возвращает число оцененных постингов
 	template <typename DocumentPredicate>
-	std::vector<Document> FindAllDocuments(std::execution::sequenced_policy policy, const Query& query, DocumentPredicate document_predicate) const;
+	size_t FindSegmentTopDocuments(const SegmentState& state, QueryContext& context, DocumentPredicate document_predicate,
+		RelevanceThreshold& threshold) const;
 
+	// документы сегмента по context.segment_query добавляются в context.matched_documents
+	template <typename DocumentPredicate>
+	void FindSegmentDocuments(std::execution::sequenced_policy policy, const SegmentState& state, QueryContext& context,
+		DocumentPredicate document_predicate) const;
 
 	template <typename DocumentPredicate>
-	std::vector<Document> FindAllDocuments(std::execution::parallel_policy policy, const Query& query, DocumentPredicate document_predicate) const;
+	void FindSegmentDocuments(std::execution::parallel_policy policy, const SegmentState& state, QueryContext& context,
+		DocumentPredicate document_predicate) const;
+
+	static bool IsDenseAccumulationProfitable(const IndexSegment& segment, const SegmentQuery& query);
+
+	// обрабатывает только документы сегмента с порядковыми номерами из [ordinal_begin, ordinal_end),
+	// накапливая релевантность в плотном массиве; найденные документы добавляются в matched_documents
+	template <typename DocumentPredicate>
+	void FindDocumentsInRange(const SegmentState& state, const SegmentQuery& query, DocumentPredicate document_predicate,
+		int ordinal_begin, int ordinal_end, DenseAccumulator& accumulator, std::vector<Document>& matched_documents) const;
+
+	static bool IsMoreRelevant(const Document& lhs, const Document& rhs);
+
+	// оставляет в documents top_count лучших документов, упорядоченных по убыванию релевантности
+	static void SelectTopDocuments(std::execution::sequenced_policy policy, std::vector<Document>& documents, size_t top_count);
+
+	static void SelectTopDocuments(std::execution::parallel_policy policy, std::vector<Document>& documents, size_t top_count);
 };
 
 
+inline bool SearchServer::IsMoreRelevant(const Document& lhs, const Document& rhs) {
+	if (std::abs(lhs.relevance - rhs.relevance) < MAX_RELEVANCE_DIFFERENCE) {
+		return lhs.rating > rhs.rating;
+	}
+	else {
+		return lhs.relevance > rhs.relevance;
+	}
+}
+
+
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const {
-	return FindTopDocuments(std::execution::par, raw_query, document_predicate);
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate, size_t top_count) const {
+	return FindTopDocuments(std::execution::par, raw_query, document_predicate, top_count);
 }
 
 
 template <typename DocumentPredicate, typename Polity>
 std::vector<Document> SearchServer::FindTopDocuments(Polity polity, std::string_view raw_query,
-	DocumentPredicate document_predicate) const {
-	const auto query = ParseQuery(raw_query, true);
-	auto matched_documents = SearchServer::FindAllDocuments(polity, query, document_predicate);
-	sort(polity, matched_documents.begin(), matched_documents.end(),
-		[](const Document& lhs, const Document& rhs) {
+	DocumentPredicate document_predicate, size_t top_count) const {
+	std::vector<Document> documents;
+	FindTopDocuments(polity, raw_query, document_predicate, documents, top_count);
+	return documents;
+}
 
-			if (std::abs(lhs.relevance - rhs.relevance) < MAX_RELEVANCE_DIFFERENCE) {
-				return lhs.rating > rhs.rating;
-			}
-			else {
-				return lhs.relevance > rhs.relevance;
-			}
-		});
+template <typename DocumentPredicate, typename Polity>
+void SearchServer::FindTopDocuments(Polity polity, std::string_view raw_query, DocumentPredicate document_predicate,
+	std::vector<Document>& documents, size_t top_count) const {
+	const auto index = LoadIndex();
+	const auto context = ScratchLease<QueryContext>::Acquire();
+	ParseQuery(*index, raw_query, true, *context);
+	FindTopQueryDocuments(polity, *index, *context, document_predicate, top_count);
+	documents.assign(context->matched_documents.begin(), context->matched_documents.end());
+}
 
-	if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-		matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+template <typename DocumentPredicate, typename Polity>
+void SearchServer::FindTopQueryDocuments(Polity polity, const IndexSnapshot& index, QueryContext& context,
+	DocumentPredicate document_predicate, size_t top_count) const {
+	SearchServer::FindAllDocuments(polity, index, context, document_predicate, top_count);
+	{
+		LOG_DURATION("SearchServer::SelectTopDocuments");
+		SelectTopDocuments(polity, context.matched_documents, top_count);
 	}
-	return matched_documents;
 }
 
 
-template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(const Query& query,
-	DocumentPredicate document_predicate) const {
-	std::map<int, double> document_to_relevance;
-	for (const std::string_view word : query.plus_words) {
-		if (word_to_document_freqs_.count(word) == 0) {
+template <typename DocumentPredicate, typename ExecutionPolicy>
+void SearchServer::FindAllDocuments(ExecutionPolicy policy, const IndexSnapshot& index, QueryContext& context,
+	DocumentPredicate document_predicate, size_t top_count) const {
+	LOG_DURATION((std::is_same_v<ExecutionPolicy, std::execution::parallel_policy> ? "SearchServer::FindAllDocuments(par)" : "SearchServer::FindAllDocuments(seq)"));
+	// idf считается один раз на запрос по всем сегментам
+	const Query& query = context.query;
+	std::vector<double>& inverse_document_freqs = context.inverse_document_freqs;
+	inverse_document_freqs.resize(query.plus_terms.size());
+	for (size_t i = 0; i < query.plus_terms.size(); ++i) {
+		inverse_document_freqs[i] = ComputeWordInverseDocumentFreq(index, query.plus_terms[i]);
+	}
 
+	// порог переходит из сегмента в сегмент, так что документы, найденные раньше, помогают отсекать в следующих сегментах
+	std::vector<Document>& matched_documents = context.matched_documents;
+	matched_documents.clear();
+	RelevanceThreshold threshold(top_count, context.threshold_relevances);
+	size_t evaluated_posting_count = 0;
+	size_t skipped_posting_count = 0;
+	for (const SegmentState& state : index.segments) {
+		// в сегменте нет ни одного документа, подходящего под типизированный предикат
+		if constexpr (IsTypedDocumentPredicate<DocumentPredicate>::value) {
+			if (!MayMatchSegment(document_predicate, *state.segment)) {
+				continue;
+			}
+		}
+		const SegmentQuery& segment_query = context.segment_query;
+		ResolveQuery(*state.segment, query, inverse_document_freqs, context.segment_query);
+		if (segment_query.plus_postings.empty()) {
 			continue;
 		}
-		const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-
-		for (const auto[document_id, term_freq] : word_to_document_freqs_.at(word)) {
-
-			const auto& document_data = documents_.at(document_id);
-
-			if (document_predicate(document_id, document_data.status, document_data.rating)) {
-
-				document_to_relevance[document_id] += term_freq * inverse_document_freq;
+		size_t posting_count = 0;
+		for (const auto& [postings, inverse_document_freq] : segment_query.plus_postings) {
+			posting_count += postings.size();
+		}
+		const size_t first_document = matched_documents.size();
+		if (IsPruningProfitable(segment_query, top_count)) {
+			const size_t evaluated = FindSegmentTopDocuments(state, context, document_predicate, threshold);
+			evaluated_posting_count += evaluated;
+			skipped_posting_count += posting_count - evaluated;
+		}
+		else {
+			FindSegmentDocuments(policy, state, context, document_predicate);
+			evaluated_posting_count += posting_count;
+			for (size_t i = first_document; i < matched_documents.size(); ++i) {
+				threshold.Add(matched_documents[i].relevance);
 			}
-
 		}
 	}
+	evaluated_posting_count += FindBufferedDocuments(index.write_buffer, context, document_predicate, threshold);
+	evaluated_posting_count_ += evaluated_posting_count;
+	skipped_posting_count_ += skipped_posting_count;
+}
 
-	for (const std::string_view word : query.minus_words) {
-
-		if (word_to_document_freqs_.count(word) == 0) {
 
-			continue;
+template <typename DocumentPredicate>
+size_t SearchServer::FindSegmentTopDocuments(const SegmentState& state, QueryContext& context, DocumentPredicate document_predicate,
+	RelevanceThreshold& threshold) const {
+	const IndexSegment& segment = *state.segment;
+	const SegmentQuery& query = context.segment_query;
+
+	// Списки идут по возрастанию верхней оценки. Первые списки, сумма оценок которых ниже порога, несущественны:
+	// документ, который есть только в них, порог не наберет. Поэтому документы перебираются по существенным спискам,
+	// а несущественные догоняют найденный документ через Seek, пока оценка еще может дотянуться до порога
+	std::vector<TermCursor>& terms = context.term_cursors;
+	terms.clear();
+	for (size_t i = 0; i < query.plus_postings.size(); ++i) {
+		terms.push_back({ PostingCursor(query.plus_postings[i].first), query.plus_postings[i].second, query.plus_upper_bounds[i] });
+	}
+	std::sort(terms.begin(), terms.end(), [](const TermCursor& lhs, const TermCursor& rhs) {
+		return lhs.upper_bound < rhs.upper_bound;
+		});
+	std::vector<double>& upper_bound_sums = context.upper_bound_sums; // оценка документа, который есть только в первых i списках
+	upper_bound_sums.assign(terms.size() + 1, 0.0);
+	for (size_t i = 0; i < terms.size(); ++i) {
+		upper_bound_sums[i + 1] = upper_bound_sums[i] + terms[i].upper_bound;
+	}
 
+	size_t essential_begin = 0;
+	const auto update_essential_begin = [&] {
+		while (essential_begin < terms.size() && upper_bound_sums[essential_begin + 1] < threshold.GetMinRelevance()) {
+			++essential_begin;
+		}
+	};
+	update_essential_begin();
+
+	context.exclusions.Assign(query.minus_postings, segment.GetDocumentCount());
+	ExclusionSet::Cursor excluded(context.exclusions);
+	size_t evaluated_posting_count = 0;
+	while (essential_begin < terms.size()) {
+		int ordinal = PostingCursor::END;
+		for (size_t i = essential_begin; i < terms.size(); ++i) {
+			ordinal = std::min(ordinal, terms[i].cursor.GetOrdinal());
+		}
+		if (ordinal == PostingCursor::END) {
+			break;
 		}
 
-		for (const auto[document_id, _] : word_to_document_freqs_.at(word)) {
+		double relevance = 0.0;
+		for (size_t i = essential_begin; i < terms.size(); ++i) {
+			PostingCursor& cursor = terms[i].cursor;
+			if (cursor.GetOrdinal() == ordinal) {
+				relevance += segment.GetTermFrequency(ordinal, cursor.GetCount()) * terms[i].inverse_document_freq;
+				cursor.Next();
+				++evaluated_posting_count;
+			}
+		}
+		if (state.IsDeleted(ordinal) || excluded.Contains(ordinal) || !IsAccepted(segment, ordinal, document_predicate)) {
+			continue;
+		}
 
-			document_to_relevance.erase(document_id);
+		const double min_relevance = threshold.GetMinRelevance();
+		bool is_competitive = true;
+		for (size_t i = essential_begin; i-- > 0;) {
+			if (relevance + upper_bound_sums[i + 1] < min_relevance) {
+				is_competitive = false;
+				break;
+			}
+			PostingCursor& cursor = terms[i].cursor;
+			cursor.Seek(ordinal);
+			if (cursor.GetOrdinal() == ordinal) {
+				relevance += segment.GetTermFrequency(ordinal, cursor.GetCount()) * terms[i].inverse_document_freq;
+				++evaluated_posting_count;
+			}
+		}
+		if (!is_competitive || relevance < min_relevance) {
+			continue;
 		}
-	}
-	std::vector<Document> matched_documents;
 
-	for (const auto[document_id, relevance] : document_to_relevance) {
-		matched_documents.push_back(
-			{ document_id, relevance, documents_.at(document_id).rating });
+		context.matched_documents.push_back({ segment.GetDocumentId(ordinal), relevance, segment.GetRating(ordinal) });
+		threshold.Add(relevance);
+		update_essential_begin();
 	}
-	return matched_documents;
+	return evaluated_posting_count;
 }
 
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(std::execution::sequenced_policy policy, const Query& query,
-	DocumentPredicate document_predicate) const {
-	return FindAllDocuments(query, document_predicate);
+size_t SearchServer::FindBufferedDocuments(const WriteBufferState& state, QueryContext& context, DocumentPredicate document_predicate,
+	RelevanceThreshold& threshold) {
+	const Query& query = context.query;
+	size_t evaluated_posting_count = 0;
+	for (int ordinal = 0; ordinal < state.document_count; ++ordinal) {
+		if (state.IsDeleted(ordinal)) {
+			continue;
+		}
+		const SegmentDocument& document = state.buffer->GetDocument(ordinal);
+		double relevance = 0.0;
+		bool is_matched = false;
+		for (size_t i = 0; i < query.plus_terms.size(); ++i) {
+			const double term_freq = FindTermFrequency(document, query.plus_terms[i]);
+			if (term_freq > 0.0) {
+				relevance += term_freq * context.inverse_document_freqs[i];
+				is_matched = true;
+				++evaluated_posting_count;
+			}
+		}
+		if (!is_matched || !document_predicate(document.document_id, document.status, document.rating)
+			|| std::any_of(query.minus_terms.begin(), query.minus_terms.end(), [&document](TermId term_id) {
+				return FindTermFrequency(document, term_id) > 0.0;
+				})) {
+			continue;
+		}
+		context.matched_documents.push_back({ document.document_id, relevance, document.rating });
+		threshold.Add(relevance);
+	}
+	return evaluated_posting_count;
 }
 
-
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(std::execution::parallel_policy policy, const Query& query,
+void SearchServer::FindSegmentDocuments(std::execution::sequenced_policy policy, const SegmentState& state, QueryContext& context,
 	DocumentPredicate document_predicate) const {
-	ConcurrentMap<int, double> document_to_relevance_two(100);
-	std::for_each(policy, query.plus_words.begin(), query.plus_words.end(), [&](std::string_view word) {
-		const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-		for (const auto[document_id, term_freq] : word_to_document_freqs_.at(word)) {
-
-			const auto& document_data = documents_.at(document_id);
-
-			if (document_predicate(document_id, document_data.status, document_data.rating)) {
+	const IndexSegment& segment = *state.segment;
+	const SegmentQuery& query = context.segment_query;
+	std::vector<Document>& matched_documents = context.matched_documents;
+	if (IsDenseAccumulationProfitable(segment, query)) {
+		const int document_count = static_cast<int>(segment.GetDocumentCount());
+		const auto accumulator = DenseAccumulator::Acquire(document_count);
+		FindDocumentsInRange(state, query, document_predicate, 0, document_count, *accumulator, matched_documents);
+		return;
+	}
 
-				//	document_to_relevance[document_id] += term_freq * inverse_document_freq;
+	// документы с минус-словами отсеиваются до оценки
+	context.exclusions.Assign(query.minus_postings, segment.GetDocumentCount());
+	// вклады постингов собираются подряд и сортируются по документу; внутри документа порядок слов
+	// сохраняется, поэтому релевантность складывается в том же порядке, что и при обходе по словам
+	std::vector<PostingRelevance>& posting_relevances = context.posting_relevances;
+	posting_relevances.clear();
+	for (size_t i = 0; i < query.plus_postings.size(); ++i) {
+		const auto& [postings, inverse_document_freq] = query.plus_postings[i];
+		ExclusionSet::Cursor excluded(context.exclusions);
+		postings.ForEach([&](int ordinal, uint32_t count) {
+			if (state.IsDeleted(ordinal) || excluded.Contains(ordinal)) {
+				return;
+			}
 
-				document_to_relevance_two[document_id].ref_to_value += term_freq * inverse_document_freq;
+			if (IsAccepted(segment, ordinal, document_predicate)) {
+				posting_relevances.push_back({ ordinal, static_cast<int>(i), segment.GetTermFrequency(ordinal, count) * inverse_document_freq });
 			}
-		}
-		});
-	std::for_each(policy, query.minus_words.begin(), query.minus_words.end(), [&](std::string_view word) {
+			});
+	}
 
-		for (const auto[document_id, _] : word_to_document_freqs_.at(word)) {
+	std::sort(posting_relevances.begin(), posting_relevances.end(), [](const PostingRelevance& lhs, const PostingRelevance& rhs) {
+		return std::tie(lhs.ordinal, lhs.term_index) < std::tie(rhs.ordinal, rhs.term_index);
+		});
+	for (size_t begin = 0; begin < posting_relevances.size();) {
+		const int ordinal = posting_relevances[begin].ordinal;
+		double relevance = 0.0;
+		size_t end = begin;
+		for (; end < posting_relevances.size() && posting_relevances[end].ordinal == ordinal; ++end) {
+			relevance += posting_relevances[end].relevance;
+		}
+		matched_documents.push_back(
+			{ segment.GetDocumentId(ordinal), relevance, segment.GetRating(ordinal) });
+		begin = end;
+	}
+}
 
-			document_to_relevance_two.Erase(document_id);
+template <typename DocumentPredicate>
+void SearchServer::FindSegmentDocuments(std::execution::parallel_policy policy, const SegmentState& state, QueryContext& context,
+	DocumentPredicate document_predicate) const {
+	const IndexSegment& segment = *state.segment;
+	const SegmentQuery& query = context.segment_query;
+	std::vector<Document>& matched_documents = context.matched_documents;
+	if (IsDenseAccumulationProfitable(segment, query)) {
+		// диапазоны номеров не пересекаются, поэтому потоки пишут в общий накопитель без синхронизации
+		const int document_count = static_cast<int>(segment.GetDocumentCount());
+		const auto accumulator = DenseAccumulator::Acquire(document_count);
+		const int range_count = static_cast<int>(std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()) * 4, document_count));
+		std::vector<std::vector<Document>> range_documents(range_count);
+		std::vector<int> range_indexes(range_count);
+		std::iota(range_indexes.begin(), range_indexes.end(), 0);
+		std::for_each(policy, range_indexes.begin(), range_indexes.end(), [&](int index) {
+			const int ordinal_begin = static_cast<int>(static_cast<int64_t>(document_count) * index / range_count);
+			const int ordinal_end = static_cast<int>(static_cast<int64_t>(document_count) * (index + 1) / range_count);
+			FindDocumentsInRange(state, query, document_predicate, ordinal_begin, ordinal_end, *accumulator, range_documents[index]);
+			});
+
+		for (const auto& documents : range_documents) {
+			matched_documents.insert(matched_documents.end(), documents.begin(), documents.end());
 		}
-		});
+		return;
+	}
 
-	auto result = document_to_relevance_two.BuildOrdinaryMap();
+	context.exclusions.Assign(query.minus_postings, segment.GetDocumentCount());
+	const ExclusionSet& exclusions = context.exclusions;
+	ConcurrentMap<int, double> document_to_relevance(RELEVANCE_MAP_BUCKET_COUNT);
+	std::for_each(policy, query.plus_postings.begin(), query.plus_postings.end(), [&](const auto& term_postings) {
+		const auto& [postings, inverse_document_freq] = term_postings;
+		ExclusionSet::Cursor excluded(exclusions);
+		postings.ForEach([&](int ordinal, uint32_t count) {
+			if (state.IsDeleted(ordinal) || excluded.Contains(ordinal)) {
+				return;
+			}
 
-	std::vector<Document> matched_documents;
+			if (IsAccepted(segment, ordinal, document_predicate)) {
+				document_to_relevance[ordinal].ref_to_value += segment.GetTermFrequency(ordinal, count) * inverse_document_freq;
+			}
+			});
+		});
 
-	for (const auto[document_id, relevance] : result) {
+	const auto result = document_to_relevance.ExtractSorted();
+	matched_documents.reserve(matched_documents.size() + result.size());
+	for (const auto& [ordinal, relevance] : result) {
+		matched_documents.push_back({ segment.GetDocumentId(ordinal), relevance, segment.GetRating(ordinal) });
+	}
+}
 
-		matched_documents.push_back(
+template <typename DocumentPredicate>
+void SearchServer::FindDocumentsInRange(const SegmentState& state, const SegmentQuery& query, DocumentPredicate document_predicate,
+	int ordinal_begin, int ordinal_end, DenseAccumulator& accumulator, std::vector<Document>& matched_documents) const {
+	using SlotState = DenseAccumulator::SlotState;
+	const IndexSegment& segment = *state.segment;
+
+	// минус-слова помечаются заранее, чтобы исключенные документы не оценивались
+	for (const auto& postings : query.minus_postings) {
+		postings.ForEach(ordinal_begin, ordinal_end, [&](int ordinal, uint32_t) {
+			accumulator.Touch(ordinal, SlotState::EXCLUDED);
+			});
+	}
 
-			{ document_id, relevance, documents_.at(document_id).rating });
+	// пока идет накопление, в Document::id лежит порядковый номер документа
+	const size_t first_document = matched_documents.size();
+	for (const auto& [postings, inverse_document_freq] : query.plus_postings) {
+		postings.ForEach(ordinal_begin, ordinal_end, [&](int ordinal, uint32_t count) {
+			if (!accumulator.IsTouched(ordinal)) {
+				// предикат вызывается один раз на документ
+				if (!state.IsDeleted(ordinal) && IsAccepted(segment, ordinal, document_predicate)) {
+					accumulator.Touch(ordinal, SlotState::ACCEPTED);
+					matched_documents.push_back({ ordinal, 0.0, segment.GetRating(ordinal) });
+				}
+				else {
+					accumulator.Touch(ordinal, SlotState::REJECTED);
+				}
+			}
+			if (accumulator.GetState(ordinal) == SlotState::ACCEPTED) {
+				accumulator.Relevance(ordinal) += segment.GetTermFrequency(ordinal, count) * inverse_document_freq;
+			}
+			});
+	}
 
+	for (size_t i = first_document; i < matched_documents.size(); ++i) {
+		Document& document = matched_documents[i];
+		document.relevance = accumulator.Relevance(document.id);
+		document.id = segment.GetDocumentId(document.id);
 	}
-	return matched_documents;
 }
 
 template <typename StringContainer>
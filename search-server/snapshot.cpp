@@ -0,0 +1,342 @@
+#include "snapshot.h"
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <filesystem>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+void SnapshotChecksum::Update(const char* data, size_t size) {
+	total_size_ += size;
+	while (size > 0 && tail_size_ > 0) {
+		tail_[tail_size_++] = *data++;
+		--size;
+		if (tail_size_ == sizeof(tail_)) {
+			uint64_t word;
+			memcpy(&word, tail_, sizeof(word));
+			Mix(word);
+			tail_size_ = 0;
+		}
+	}
+	for (; size >= sizeof(uint64_t); data += sizeof(uint64_t), size -= sizeof(uint64_t)) {
+		uint64_t word;
+		memcpy(&word, data, sizeof(word));
+		Mix(word);
+	}
+	if (size > 0) {
+		copy(data, data + size, tail_);
+		tail_size_ = size;
+	}
+}
+
+uint64_t SnapshotChecksum::Get() const {
+	SnapshotChecksum result = *this;
+	uint64_t word = 0;
+	memcpy(&word, tail_, tail_size_);
+	result.Mix(word);
+	result.Mix(total_size_);
+	uint64_t hash = result.hash_;
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccd;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+void SnapshotChecksum::Mix(uint64_t word) {
+	hash_ = (rotl(hash_, 23) ^ word) * 0x9e3779b97f4a7c15;
+}
+
+SnapshotWriter::SnapshotWriter(const string& path)
+	: path_(path)
+	, temp_path_(path + ".tmp")
+	, output_(temp_path_, ios::binary | ios::trunc) {
+	if (!output_) {
+		throw runtime_error("Cannot create snapshot file " + temp_path_);
+	}
+	copy(begin(SNAPSHOT_MAGIC), end(SNAPSHOT_MAGIC), header_.magic);
+	header_.version = SNAPSHOT_VERSION;
+	header_.byte_order = SNAPSHOT_BYTE_ORDER;
+	for (SnapshotSectionEntry& entry : header_.sections) {
+		entry = { SNAPSHOT_HEADER_SIZE, 0, SnapshotChecksum().Get() }; // пустая секция, если ее не запишут
+	}
+	const string zeros(SNAPSHOT_HEADER_SIZE, '\0');
+	output_.write(zeros.data(), zeros.size());
+	position_ = SNAPSHOT_HEADER_SIZE;
+}
+
+void SnapshotWriter::BeginSection(SnapshotSection section) {
+	FinishSection();
+	Pad();
+	section_ = section;
+	header_.sections[static_cast<size_t>(section)] = { position_, 0 };
+	checksum_ = {};
+}
+
+void SnapshotWriter::Write(const void* data, size_t size) {
+	output_.write(static_cast<const char*>(data), size);
+	checksum_.Update(static_cast<const char*>(data), size);
+	position_ += size;
+	header_.sections[static_cast<size_t>(section_)].size += size;
+}
+
+void SnapshotWriter::Finish() {
+	// после последней секции выравнивания нет: каждый байт файла покрыт контрольной суммой
+	FinishSection();
+	header_.file_size = position_;
+	SnapshotChecksum checksum;
+	checksum.Update(reinterpret_cast<const char*>(&header_), sizeof(header_));
+	header_.checksum = checksum.Get();
+	output_.seekp(0);
+	output_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+	output_.close();
+	if (!output_) {
+		throw runtime_error("Cannot write snapshot file " + temp_path_);
+	}
+	filesystem::rename(temp_path_, path_);
+	finished_ = true;
+}
+
+SnapshotWriter::~SnapshotWriter() {
+	if (!finished_) {
+		output_.close();
+		error_code error;
+		filesystem::remove(temp_path_, error);
+	}
+}
+
+void SnapshotWriter::Pad() {
+	static const char zeros[SNAPSHOT_ALIGNMENT] = {};
+	const size_t padding = (SNAPSHOT_ALIGNMENT - position_ % SNAPSHOT_ALIGNMENT) % SNAPSHOT_ALIGNMENT;
+	output_.write(zeros, padding);
+	position_ += padding;
+}
+
+void SnapshotWriter::FinishSection() {
+	if (section_ != SnapshotSection::COUNT) {
+		header_.sections[static_cast<size_t>(section_)].checksum = checksum_.Get();
+	}
+}
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const string& path) {
+	ifstream input(path, ios::binary | ios::ate);
+	if (!input) {
+		throw runtime_error("Cannot open file " + path);
+	}
+	size_ = static_cast<size_t>(input.tellg());
+	buffer_ = make_unique<uint64_t[]>(size_ / sizeof(uint64_t) + 1);
+	input.seekg(0);
+	if (!input.read(reinterpret_cast<char*>(buffer_.get()), size_)) {
+		throw runtime_error("Cannot read file " + path);
+	}
+	data_ = reinterpret_cast<const char*>(buffer_.get());
+}
+
+MappedFile::~MappedFile() = default;
+
+#else
+
+MappedFile::MappedFile(const string& path) {
+	const int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw runtime_error("Cannot open file " + path);
+	}
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) != 0) {
+		close(fd);
+		throw runtime_error("Cannot read file " + path);
+	}
+	size_ = static_cast<size_t>(file_stat.st_size);
+	if (size_ > 0) {
+		void* const data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+		if (data == MAP_FAILED) {
+			close(fd);
+			throw runtime_error("Cannot map file " + path);
+		}
+		data_ = static_cast<const char*>(data);
+	}
+	close(fd); // отображение остается действительным и после закрытия файла
+}
+
+MappedFile::~MappedFile() {
+	if (data_ != nullptr) {
+		munmap(const_cast<char*>(data_), size_);
+	}
+}
+
+#endif
+
+SnapshotReader::SnapshotReader(shared_ptr<const MappedFile> file)
+	: file_(move(file)) {
+	if (file_->size() < SNAPSHOT_HEADER_SIZE) {
+		throw invalid_argument("Invalid snapshot: file is too small");
+	}
+	header_ = reinterpret_cast<const SnapshotHeader*>(file_->data());
+	if (!equal(begin(SNAPSHOT_MAGIC), end(SNAPSHOT_MAGIC), header_->magic)) {
+		throw invalid_argument("Invalid snapshot: not a snapshot file");
+	}
+	if (header_->byte_order != SNAPSHOT_BYTE_ORDER) {
+		throw invalid_argument("Invalid snapshot: byte order mismatch");
+	}
+	if (header_->version != SNAPSHOT_VERSION) {
+		throw invalid_argument("Invalid snapshot: unsupported version");
+	}
+	if (header_->file_size != file_->size()) {
+		throw invalid_argument("Invalid snapshot: file size mismatch");
+	}
+
+	// секции проверяются по своим суммам, когда их берут
+	SnapshotChecksum checksum;
+	SnapshotHeader header = *header_;
+	header.checksum = 0;
+	checksum.Update(reinterpret_cast<const char*>(&header), sizeof(header));
+	if (checksum.Get() != header_->checksum) {
+		throw invalid_argument("Invalid snapshot: checksum mismatch");
+	}
+
+	for (const SnapshotSectionEntry& entry : header_->sections) {
+		if (entry.offset % SNAPSHOT_ALIGNMENT != 0 || entry.offset < SNAPSHOT_HEADER_SIZE
+			|| entry.offset > file_->size() || entry.size > file_->size() - entry.offset) {
+			throw invalid_argument("Invalid snapshot: bad section bounds");
+		}
+	}
+}
+
+void SnapshotReader::CheckSectionChecksum(SnapshotSection section) const {
+	const SnapshotSectionEntry& entry = header_->sections[static_cast<size_t>(section)];
+	SnapshotChecksum checksum;
+	checksum.Update(file_->data() + entry.offset, entry.size);
+	if (checksum.Get() != entry.checksum) {
+		throw invalid_argument("Invalid snapshot: checksum mismatch");
+	}
+}
+
+vector<string_view> SnapshotReader::GetStrings(SnapshotSection offsets_section, SnapshotSection chars_section) const {
+	const auto offsets = GetSection<uint64_t>(offsets_section);
+	const auto chars = GetSection<char>(chars_section);
+	CheckSnapshotOffsets(offsets, chars.size());
+	vector<string_view> strings;
+	strings.reserve(offsets.size() - 1);
+	for (size_t i = 0; i + 1 < offsets.size(); ++i) {
+		strings.push_back({ chars.data() + offsets[i], offsets[i + 1] - offsets[i] });
+	}
+	return strings;
+}
+
+void CheckSnapshotOffsets(span<const uint64_t> offsets, size_t size) {
+	if (offsets.empty() || offsets.front() != 0 || offsets.back() != size || !is_sorted(offsets.begin(), offsets.end())) {
+		throw invalid_argument("Invalid snapshot: bad offsets");
+	}
+}
+
+void CheckSnapshotPostingOffsets(const InvertedIndex& postings) {
+	const auto offsets = postings.GetOffsets();
+	const auto block_offsets = postings.GetBlockOffsets();
+	CheckSnapshotOffsets(offsets, offsets.empty() ? 0 : offsets.back());
+	CheckSnapshotOffsets(block_offsets, postings.GetBlocks().size());
+	if (block_offsets.size() != offsets.size()) {
+		throw invalid_argument("Invalid snapshot: bad offsets");
+	}
+	for (size_t term = 0; term + 1 < offsets.size(); ++term) {
+		if (block_offsets[term + 1] - block_offsets[term] != (offsets[term + 1] - offsets[term] + POSTING_BLOCK_SIZE - 1) / POSTING_BLOCK_SIZE) {
+			throw invalid_argument("Invalid snapshot: bad posting list");
+		}
+	}
+}
+
+uint64_t ComputePostingListChecksum(const InvertedIndex& postings, size_t term) {
+	const auto blocks = postings.GetBlocks().subspan(postings.GetBlockOffsets()[term],
+		postings.GetBlockOffsets()[term + 1] - postings.GetBlockOffsets()[term]);
+	const auto data = postings.GetData();
+	SnapshotChecksum checksum;
+	for (const PostingBlock& block : blocks) {
+		checksum.Update(reinterpret_cast<const char*>(&block), sizeof(block));
+		// значения блока за пределами данных ловит проверка блока, сумма берется только по существующим
+		const size_t begin = min<size_t>(block.data_offset, data.size());
+		const size_t end = min<size_t>(begin + GetPostingBlockWords(block), data.size());
+		checksum.Update(reinterpret_cast<const char*>(data.data() + begin), (end - begin) * sizeof(uint32_t));
+	}
+	return checksum.Get();
+}
+
+void CheckSnapshotPostingList(const InvertedIndex& postings, size_t term, size_t document_count, uint64_t checksum) {
+	if (ComputePostingListChecksum(postings, term) != checksum) {
+		throw invalid_argument("Invalid snapshot: checksum mismatch");
+	}
+	const auto offsets = postings.GetOffsets();
+	const auto block_offsets = postings.GetBlockOffsets();
+	const auto blocks = postings.GetBlocks();
+	const auto data = postings.GetData();
+	uint32_t documents[POSTING_BLOCK_SIZE];
+	uint32_t counts[POSTING_BLOCK_SIZE];
+	uint64_t remaining = offsets[term + 1] - offsets[term];
+	int64_t previous_document = -1;
+	for (uint64_t i = block_offsets[term]; i < block_offsets[term + 1]; ++i) {
+		const PostingBlock& block = blocks[i];
+		if (block.size != min<uint64_t>(POSTING_BLOCK_SIZE, remaining) || block.document_bits > 32 || block.count_bits > 32
+			|| block.data_offset + static_cast<uint64_t>(GetPostingBlockWords(block)) > data.size()) {
+			throw invalid_argument("Invalid snapshot: bad posting block");
+		}
+		DecodePostingBlock(block, data.data(), static_cast<int>(previous_document), documents, counts);
+		for (size_t j = 0; j < block.size; ++j) {
+			if (documents[j] <= previous_document || documents[j] >= document_count || counts[j] == 0) {
+				throw invalid_argument("Invalid snapshot: bad posting list");
+			}
+			previous_document = documents[j];
+		}
+		if (block.last_document != previous_document) {
+			throw invalid_argument("Invalid snapshot: bad posting block");
+		}
+		remaining -= block.size;
+	}
+}
+
+void CheckSnapshotColumns(const SegmentColumns& columns, size_t term_count) {
+	const size_t document_count = columns.document_ids.size();
+	const size_t bitmap_words = GetStatusBitmapWords(document_count);
+	if (columns.ratings.size() != document_count || columns.statuses.size() != document_count
+		|| columns.word_counts.size() != document_count || columns.inverse_word_counts.size() != document_count
+		|| columns.status_bitmaps.size() != DOCUMENT_STATUS_COUNT * bitmap_words || columns.max_term_freqs.size() != columns.terms.size()) {
+		throw invalid_argument("Invalid snapshot: column size mismatch");
+	}
+	for (size_t i = 0; i < columns.terms.size(); ++i) {
+		if (columns.terms[i] >= term_count || (i > 0 && columns.terms[i - 1] >= columns.terms[i])) {
+			throw invalid_argument("Invalid snapshot: bad segment terms");
+		}
+	}
+	CheckSnapshotOffsets(columns.term_offsets, columns.term_freqs.size());
+	if (columns.term_offsets.size() != document_count + 1) {
+		throw invalid_argument("Invalid snapshot: bad offsets");
+	}
+
+	// у каждого документа ровно один бит статуса: его бит стоит, а всего бит столько же, сколько документов
+	size_t status_bit_count = 0;
+	for (const uint64_t word : columns.status_bitmaps) {
+		status_bit_count += popcount(word);
+	}
+	if (status_bit_count != document_count) {
+		throw invalid_argument("Invalid snapshot: bad status bitmaps");
+	}
+	for (size_t ordinal = 0; ordinal < document_count; ++ordinal) {
+		const size_t status = static_cast<size_t>(columns.statuses[ordinal]);
+		if (columns.document_ids[ordinal] < 0 || (ordinal > 0 && columns.document_ids[ordinal - 1] >= columns.document_ids[ordinal])
+			|| status >= DOCUMENT_STATUS_COUNT || columns.word_counts[ordinal] < 0
+			|| ((columns.status_bitmaps[status * bitmap_words + ordinal / 64] >> (ordinal % 64)) & 1) == 0) {
+			throw invalid_argument("Invalid snapshot: bad document");
+		}
+		for (uint64_t i = columns.term_offsets[ordinal]; i < columns.term_offsets[ordinal + 1]; ++i) {
+			if (columns.term_freqs[i].term_id >= columns.terms.size()
+				|| (i > columns.term_offsets[ordinal] && columns.term_freqs[i - 1].term_id >= columns.term_freqs[i].term_id)) {
+				throw invalid_argument("Invalid snapshot: bad document terms");
+			}
+		}
+	}
+}
@@ -0,0 +1,206 @@
+#pragma once
+#include "index_segment.h"
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Формат снимка SearchServer. Файл - заголовок и секции, выровненные по SNAPSHOT_ALIGNMENT. Секции сегмента повторяют
+// его столбцы и сжатые списки слов, поэтому после mmap сегмент и текст слов используются прямо из файла.
+// У заголовка и каждой секции своя контрольная сумма; списки слов проверяются по одному при первом обращении.
+// Числа хранятся в порядке байтов машины; чужой порядок распознается по SNAPSHOT_BYTE_ORDER.
+const char SNAPSHOT_MAGIC[8] = { 'S', 'S', 'R', 'V', 'S', 'N', 'A', 'P' };
+const uint32_t SNAPSHOT_VERSION = 5;
+const uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+const size_t SNAPSHOT_ALIGNMENT = 64;
+
+enum class SnapshotSection : uint32_t {
+	STOP_WORD_OFFSETS, // uint64_t[n + 1]
+	STOP_WORD_CHARS,
+	TERM_OFFSETS, // uint64_t[n + 1], номер слова - индекс
+	TERM_CHARS,
+	SEGMENT_TERMS, // TermId, номера слов сегмента по возрастанию
+	SEGMENT_MAX_TERM_FREQS, // double по словам сегмента
+	POSTING_OFFSETS, // uint64_t[n + 1], число постингов слов сегмента нарастающим итогом
+	POSTING_BLOCK_OFFSETS, // uint64_t[n + 1], начало блоков слова в POSTING_BLOCKS
+	POSTING_CHECKSUMS, // uint64_t по словам сегмента, контрольные суммы блоков слова с их значениями
+	POSTING_BLOCKS, // PostingBlock, номера документов - порядковые номера сегмента; контрольная сумма секции не проверяется
+	POSTING_DATA, // uint32_t, упакованные значения блоков; контрольная сумма секции не проверяется
+	DOCUMENT_IDS, // int32_t по возрастанию, только живые документы
+	DOCUMENT_RATINGS, // int32_t
+	DOCUMENT_STATUSES, // DocumentStatus
+	DOCUMENT_STATUS_BITMAPS, // uint64_t, битовые карты статусов подряд
+	DOCUMENT_WORD_COUNTS, // int32_t
+	DOCUMENT_INVERSE_WORD_COUNTS, // double
+	DOCUMENT_TERM_OFFSETS, // uint64_t[n + 1], начало слов документа в DOCUMENT_TERMS
+	DOCUMENT_TERMS, // TermFrequency с номерами слов сегмента
+	COUNT,
+};
+
+struct SnapshotSectionEntry {
+	uint64_t offset = 0;
+	uint64_t size = 0;
+	uint64_t checksum = 0;
+};
+
+struct SnapshotHeader {
+	char magic[8] = {};
+	uint32_t version = 0;
+	uint32_t byte_order = 0;
+	uint64_t file_size = 0;
+	uint64_t checksum = 0; // заголовка с нулевым checksum; секции со своими суммами он покрывает через sections
+	SnapshotSectionEntry sections[static_cast<size_t>(SnapshotSection::COUNT)];
+};
+
+const size_t SNAPSHOT_HEADER_SIZE = (sizeof(SnapshotHeader) + SNAPSHOT_ALIGNMENT - 1) / SNAPSHOT_ALIGNMENT * SNAPSHOT_ALIGNMENT;
+
+// 64-битная контрольная сумма, считается словами по 8 байт; данные можно подавать кусками любой длины
+class SnapshotChecksum {
+public:
+	void Update(const char* data, size_t size);
+
+	uint64_t Get() const;
+
+private:
+	uint64_t hash_ = 0xcbf29ce484222325;
+	char tail_[8] = {};
+	size_t tail_size_ = 0;
+	uint64_t total_size_ = 0;
+
+	void Mix(uint64_t word);
+};
+
+// Пишет снимок во временный файл и переименовывает его в конце, так что старый снимок не портится при сбое
+class SnapshotWriter {
+public:
+	explicit SnapshotWriter(const std::string& path);
+
+	void BeginSection(SnapshotSection section);
+
+	void Write(const void* data, size_t size);
+
+	template <typename Record>
+	void WriteRecords(std::span<const Record> records) {
+		Write(records.data(), records.size_bytes());
+	}
+
+	template <typename Record>
+	void WriteRecords(const std::vector<Record>& records) {
+		WriteRecords(std::span<const Record>(records));
+	}
+
+	template <typename StringContainer>
+	void WriteStrings(SnapshotSection offsets_section, SnapshotSection chars_section, const StringContainer& strings) {
+		std::vector<uint64_t> offsets(1, 0);
+		for (const auto& text : strings) {
+			offsets.push_back(offsets.back() + text.size());
+		}
+		BeginSection(offsets_section);
+		WriteRecords(offsets);
+		BeginSection(chars_section);
+		for (const auto& text : strings) {
+			Write(text.data(), text.size());
+		}
+	}
+
+	// заголовок пишется последним, до этого файл называется path + ".tmp"
+	void Finish();
+
+	~SnapshotWriter();
+
+private:
+	std::string path_;
+	std::string temp_path_;
+	std::ofstream output_;
+	SnapshotHeader header_;
+	SnapshotChecksum checksum_; // текущей секции
+	uint64_t position_ = 0;
+	SnapshotSection section_ = SnapshotSection::COUNT;
+	bool finished_ = false;
+
+	void Pad();
+
+	void FinishSection();
+};
+
+// Файл, отображенный в память только для чтения. Страницы берутся из page cache и общие для процессов;
+// там, где mmap нет, файл читается в выровненный буфер
+class MappedFile {
+public:
+	explicit MappedFile(const std::string& path);
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	~MappedFile();
+
+	const char* data() const {
+		return data_;
+	}
+
+	size_t size() const {
+		return size_;
+	}
+
+private:
+	const char* data_ = nullptr;
+	size_t size_ = 0;
+	std::unique_ptr<uint64_t[]> buffer_;
+};
+
+// Снимок с проверенным заголовком: версия, размеры и границы секций. Секции отдаются как типизированные массивы;
+// контрольная сумма секции проверяется, когда ее берут через GetSection
+class SnapshotReader {
+public:
+	explicit SnapshotReader(std::shared_ptr<const MappedFile> file);
+
+	template <typename Record>
+	std::span<const Record> GetSection(SnapshotSection section) const {
+		CheckSectionChecksum(section);
+		return GetUncheckedSection<Record>(section);
+	}
+
+	// без контрольной суммы секции: данные проверяет тот, кто их читает
+	template <typename Record>
+	std::span<const Record> GetUncheckedSection(SnapshotSection section) const {
+		const SnapshotSectionEntry& entry = header_->sections[static_cast<size_t>(section)];
+		if (entry.size % sizeof(Record) != 0) {
+			throw std::invalid_argument("Invalid snapshot: bad section size");
+		}
+		return { reinterpret_cast<const Record*>(file_->data() + entry.offset), entry.size / sizeof(Record) };
+	}
+
+	// строки из пары секций смещений и символов
+	std::vector<std::string_view> GetStrings(SnapshotSection offsets_section, SnapshotSection chars_section) const;
+
+	const std::shared_ptr<const MappedFile>& GetFile() const {
+		return file_;
+	}
+
+private:
+	std::shared_ptr<const MappedFile> file_;
+	const SnapshotHeader* header_ = nullptr;
+
+	void CheckSectionChecksum(SnapshotSection section) const;
+};
+
+// проверка массива смещений: начинается с 0, не убывает и заканчивается на size
+void CheckSnapshotOffsets(std::span<const uint64_t> offsets, size_t size);
+
+// проверка смещений сжатых списков: постингов и блоков у каждого слова согласованно
+void CheckSnapshotPostingOffsets(const InvertedIndex& postings);
+
+// контрольная сумма блоков списка слова term с их упакованными значениями
+uint64_t ComputePostingListChecksum(const InvertedIndex& postings, size_t term);
+
+// проверка сжатого списка слова: контрольная сумма, блоки распаковываются, номера документов возрастают и меньше document_count
+void CheckSnapshotPostingList(const InvertedIndex& postings, size_t term, size_t document_count, uint64_t checksum);
+
+// проверка столбцов сегмента снимка: размеры согласованы, id возрастают, статусы совпадают с битовыми картами,
+// слова документов возрастают и есть в сегменте; term_count - число слов словаря
+void CheckSnapshotColumns(const SegmentColumns& columns, size_t term_count);
@@ -0,0 +1,135 @@
+#include "stop_word_set.h"
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+// в среднем слов на корзину; чем больше, тем меньше таблица сдвигов, но дольше подбор
+const size_t WORDS_PER_BUCKET = 4;
+const uint32_t MAX_DISPLACEMENT = 1 << 16;
+const int MAX_BUILD_ATTEMPTS = 64;
+
+uint64_t Mix(uint64_t value) {
+	value ^= value >> 33;
+	value *= 0xff51afd7ed558ccd;
+	value ^= value >> 33;
+	value *= 0xc4ceb9fe1a85ec53;
+	value ^= value >> 33;
+	return value;
+}
+
+size_t GetBucket(uint64_t hash, size_t bucket_count) {
+	return static_cast<size_t>(((hash >> 32) * bucket_count) >> 32);
+}
+
+size_t GetSlot(uint64_t hash, uint32_t displacement, size_t slot_count) {
+	return static_cast<size_t>(Mix(hash + displacement * 0x9e3779b97f4a7c15) & (slot_count - 1));
+}
+
+}
+
+StopWordSet::StopWordSet(const set<string, less<>>& words)
+	: words_(words.begin(), words.end()) {
+	if (words_.empty()) {
+		return;
+	}
+	if (words_.size() >= NO_WORD) {
+		throw invalid_argument("Too many stop words");
+	}
+	for (const string& word : words_) {
+		if (word.empty()) {
+			throw invalid_argument("Stop word is empty");
+		}
+		length_mask_ |= uint64_t{ 1 } << min<size_t>(word.size(), 63);
+		const auto first_byte = static_cast<unsigned char>(word[0]);
+		first_byte_mask_[first_byte / 64] |= uint64_t{ 1 } << (first_byte % 64);
+	}
+
+	// таблица заполнена не больше чем на 4/5; если сдвиги не подбираются, меняется seed, а потом и размер
+	size_t slot_count = bit_ceil(words_.size() + words_.size() / 4);
+	for (int attempt = 0;; ++attempt) {
+		seed_ = Mix(attempt + 1);
+		if (TryBuild(slot_count)) {
+			return;
+		}
+		if (attempt % 8 == 7) {
+			slot_count *= 2;
+		}
+		if (attempt == MAX_BUILD_ATTEMPTS) {
+			throw invalid_argument("Failed to build stop word hash");
+		}
+	}
+}
+
+uint64_t StopWordSet::Hash(string_view word, uint64_t seed) {
+	uint64_t hash = seed ^ (word.size() * 0x9e3779b97f4a7c15);
+	size_t position = 0;
+	for (; position + 8 <= word.size(); position += 8) {
+		uint64_t chunk;
+		memcpy(&chunk, word.data() + position, 8);
+		hash = Mix(hash ^ chunk);
+	}
+	uint64_t tail = 0;
+	memcpy(&tail, word.data() + position, word.size() - position);
+	return Mix(hash ^ tail);
+}
+
+size_t StopWordSet::FindSlot(string_view word) const {
+	const uint64_t hash = Hash(word, seed_);
+	return GetSlot(hash, displacements_[GetBucket(hash, displacements_.size())], slots_.size());
+}
+
+bool StopWordSet::TryBuild(size_t slot_count) {
+	const size_t bucket_count = (words_.size() + WORDS_PER_BUCKET - 1) / WORDS_PER_BUCKET;
+	vector<uint64_t> hashes(words_.size());
+	vector<vector<uint32_t>> buckets(bucket_count);
+	for (uint32_t index = 0; index < words_.size(); ++index) {
+		hashes[index] = Hash(words_[index], seed_);
+		buckets[GetBucket(hashes[index], bucket_count)].push_back(index);
+	}
+
+	// большие корзины размещаются первыми, пока свободных слотов много
+	vector<uint32_t> bucket_order(bucket_count);
+	for (uint32_t bucket = 0; bucket < bucket_count; ++bucket) {
+		bucket_order[bucket] = bucket;
+	}
+	stable_sort(bucket_order.begin(), bucket_order.end(), [&](uint32_t lhs, uint32_t rhs) {
+		return buckets[lhs].size() > buckets[rhs].size();
+		});
+
+	displacements_.assign(bucket_count, 0);
+	slots_.assign(slot_count, NO_WORD);
+	vector<size_t> bucket_slots;
+	for (const uint32_t bucket : bucket_order) {
+		const auto& bucket_words = buckets[bucket];
+		if (bucket_words.empty()) {
+			break;
+		}
+		bool is_placed = false;
+		for (uint32_t displacement = 0; displacement < MAX_DISPLACEMENT && !is_placed; ++displacement) {
+			bucket_slots.clear();
+			is_placed = true;
+			for (const uint32_t index : bucket_words) {
+				const size_t slot = GetSlot(hashes[index], displacement, slot_count);
+				if (slots_[slot] != NO_WORD || find(bucket_slots.begin(), bucket_slots.end(), slot) != bucket_slots.end()) {
+					is_placed = false;
+					break;
+				}
+				bucket_slots.push_back(slot);
+			}
+			if (is_placed) {
+				displacements_[bucket] = displacement;
+				for (size_t i = 0; i < bucket_words.size(); ++i) {
+					slots_[bucket_slots[i]] = bucket_words[i];
+				}
+			}
+		}
+		if (!is_placed) {
+			return false;
+		}
+	}
+	return true;
+}
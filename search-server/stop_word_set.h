@@ -0,0 +1,60 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Стоп-слова, замороженные при создании сервера. Слово сначала отсеивается по длине и первому байту,
+// затем ищется совершенной хеш-функцией (hash-and-displace): хеш слова выбирает корзину, сдвиг корзины
+// дает единственный слот, где слово может лежать, поэтому нужно не больше одного сравнения строк
+class StopWordSet {
+public:
+	StopWordSet() = default;
+
+	explicit StopWordSet(const std::set<std::string, std::less<>>& words);
+
+	bool Contains(std::string_view word) const {
+		const size_t length_bit = std::min<size_t>(word.size(), 63);
+		if (((length_mask_ >> length_bit) & 1) == 0) {
+			return false;
+		}
+		const auto first_byte = static_cast<unsigned char>(word[0]);
+		if (((first_byte_mask_[first_byte / 64] >> (first_byte % 64)) & 1) == 0) {
+			return false;
+		}
+		const uint32_t index = slots_[FindSlot(word)];
+		return index != NO_WORD && words_[index] == word;
+	}
+
+	// слова по возрастанию
+	std::vector<std::string>::const_iterator begin() const {
+		return words_.begin();
+	}
+
+	std::vector<std::string>::const_iterator end() const {
+		return words_.end();
+	}
+
+	size_t size() const {
+		return words_.size();
+	}
+
+private:
+	static constexpr uint32_t NO_WORD = UINT32_MAX;
+
+	std::vector<std::string> words_;
+	uint64_t length_mask_ = 0; // бит min(длина, 63) для каждого слова; пустых слов нет, бит 0 не ставится
+	uint64_t first_byte_mask_[4] = {};
+	uint64_t seed_ = 0;
+	std::vector<uint32_t> displacements_; // по корзинам
+	std::vector<uint32_t> slots_; // номер слова в words_ или NO_WORD; размер - степень двойки
+
+	static uint64_t Hash(std::string_view word, uint64_t seed);
+
+	size_t FindSlot(std::string_view word) const;
+
+	// false, если при этом seed_ какие-то корзины не удалось разместить
+	bool TryBuild(size_t slot_count);
+};
@@ -1,14 +1,76 @@
 #include "string_processing.h" 
 
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define STRING_PROCESSING_SSE2
+#endif
+
 using namespace std;
 
+namespace {
+	const size_t CHUNK_SIZE = 16;
+
+	// управляющий символ: код от 0 до 31
+	bool IsControlChar(char c) {
+		return static_cast<unsigned char>(c) < ' ';
+	}
+
+	int CountTrailingZeros(uint32_t mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return static_cast<int>(index);
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+}
+
+size_t SplitIntoWords(string_view text, vector<string_view>& words) {
+	words.clear();
+	size_t invalid_word = WORDS_ARE_VALID;
+	size_t word_begin = 0;
+	size_t position = 0;
+
+	// один проход: в каждом блоке из 16 байт сразу ищутся и пробелы, и управляющие символы;
+	// биты масок разбираются по порядку, так что слово с первым управляющим символом известно точно
+#ifdef STRING_PROCESSING_SSE2
+	const __m128i spaces = _mm_set1_epi8(' ');
+	const __m128i max_control = _mm_set1_epi8(' ' - 1);
+	for (; position + CHUNK_SIZE <= text.size(); position += CHUNK_SIZE) {
+		const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(text.data() + position));
+		const uint32_t space_mask = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, spaces)));
+		// без знака: байт не больше 31, если min(байт, 31) равен ему самому
+		const uint32_t control_mask = invalid_word == WORDS_ARE_VALID
+			? static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(chunk, max_control), chunk))) : 0;
+		for (uint32_t mask = space_mask | control_mask; mask != 0; mask &= mask - 1) {
+			const int bit = CountTrailingZeros(mask);
+			if ((space_mask >> bit) & 1) {
+				words.push_back(text.substr(word_begin, position + bit - word_begin));
+				word_begin = position + bit + 1;
+			}
+			else if (invalid_word == WORDS_ARE_VALID) {
+				invalid_word = words.size();
+			}
+		}
+	}
+#endif
+
+	for (; position < text.size(); ++position) {
+		if (text[position] == ' ') {
+			words.push_back(text.substr(word_begin, position - word_begin));
+			word_begin = position + 1;
+		}
+		else if (invalid_word == WORDS_ARE_VALID && IsControlChar(text[position])) {
+			invalid_word = words.size();
+		}
+	}
+	words.push_back(text.substr(word_begin));
+	return invalid_word;
+}
+
 vector<string_view> SplitIntoWords(string_view text) {
 	vector<string_view> words;
-	while (true) {
-		const auto space = text.find(' ');
-		words.push_back(text.substr(0, space));
-		if (space == text.npos) break;
-		else text.remove_prefix(space + 1);
-	}
+	SplitIntoWords(text, words);
 	return words;
-}
\ No newline at end of file
+}
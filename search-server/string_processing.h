@@ -1,8 +1,17 @@
 #pragma once 
+#include <cstdint>
 #include <string> 
+#include <string_view>
 #include <vector> 
 #include <set> 
 
+const size_t WORDS_ARE_VALID = static_cast<size_t>(-1);
+
+// Разбивает текст по пробелам за один проход (SSE2, где он есть) и заодно ищет управляющие символы (код меньше пробела).
+// Слова пишутся в words: буфер вызывающего очищается, но его память переиспользуется.
+// Возвращает номер первого слова с управляющим символом или WORDS_ARE_VALID
+size_t SplitIntoWords(std::string_view text, std::vector<std::string_view>& words);
+
 std::vector<std::string_view> SplitIntoWords(std::string_view text);
 
 template <typename StringContainer>
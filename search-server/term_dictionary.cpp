@@ -0,0 +1,125 @@
+#include "term_dictionary.h"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+string_view StringArena::Store(string_view text) {
+	if (text.size() > free_size_) {
+		// длинные строки получают собственный блок, чтобы не терять остаток текущего
+		const size_t block_size = max(BLOCK_SIZE, text.size());
+		blocks_.push_back(make_unique<char[]>(block_size));
+		allocated_bytes_ += block_size;
+		if (block_size > BLOCK_SIZE) {
+			copy(text.begin(), text.end(), blocks_.back().get());
+			return { blocks_.back().get(), text.size() };
+		}
+		free_begin_ = blocks_.back().get();
+		free_size_ = block_size;
+	}
+	char* const begin = free_begin_;
+	copy(text.begin(), text.end(), begin);
+	free_begin_ += text.size();
+	free_size_ -= text.size();
+	return { begin, text.size() };
+}
+
+TermDictionary::Table::Table(size_t capacity)
+	: capacity(capacity)
+	, slots(new atomic<TermId>[capacity])
+	, terms(new string_view[capacity / 2]) {
+	for (size_t slot = 0; slot < capacity; ++slot) {
+		slots[slot].store(NO_TERM, memory_order_relaxed);
+	}
+}
+
+TermDictionary::TermDictionary() {
+	Grow(INITIAL_CAPACITY);
+}
+
+TermId TermDictionary::Intern(string_view term) {
+	const TermId term_id = Find(term);
+	if (term_id != NO_TERM) {
+		return term_id;
+	}
+	return Add(arena_.Store(term));
+}
+
+TermId TermDictionary::InternExternal(string_view term) {
+	const TermId term_id = Find(term);
+	if (term_id != NO_TERM) {
+		return term_id;
+	}
+	return Add(term);
+}
+
+void TermDictionary::Reserve(size_t term_count) {
+	size_t capacity = tables_.back()->capacity;
+	while (term_count * 2 > capacity) {
+		capacity *= 2;
+	}
+	if (capacity > tables_.back()->capacity) {
+		Grow(capacity);
+	}
+}
+
+TermId TermDictionary::Find(string_view term) const {
+	const Table* table = table_.load(memory_order_acquire);
+	const size_t mask = table->capacity - 1;
+	for (size_t slot = hash<string_view>{}(term) & mask;; slot = (slot + 1) & mask) {
+		const TermId term_id = table->slots[slot].load(memory_order_acquire);
+		if (term_id == NO_TERM) {
+			return NO_TERM;
+		}
+		if (table->terms[term_id] == term) {
+			return term_id;
+		}
+	}
+}
+
+size_t TermDictionary::GetAllocatedBytes() const {
+	size_t bytes = arena_.GetAllocatedBytes();
+	for (const auto& table : tables_) {
+		bytes += table->capacity * sizeof(atomic<TermId>) + table->capacity / 2 * sizeof(string_view);
+	}
+	return bytes;
+}
+
+TermId TermDictionary::Add(string_view stored_term) {
+	const size_t term_id = size_.load(memory_order_relaxed);
+	if (term_id >= NO_TERM) {
+		throw length_error("Term dictionary is full");
+	}
+	if ((term_id + 1) * 2 > tables_.back()->capacity) {
+		Grow(tables_.back()->capacity * 2);
+	}
+	// текст слова записывается раньше, чем номер становится виден в слоте
+	Table& table = *tables_.back();
+	table.terms[term_id] = stored_term;
+	Insert(table, static_cast<TermId>(term_id));
+	size_.store(term_id + 1, memory_order_release);
+	return static_cast<TermId>(term_id);
+}
+
+void TermDictionary::Grow(size_t capacity) {
+	auto table = make_unique<Table>(capacity);
+	const size_t term_count = size_.load(memory_order_relaxed);
+	if (!tables_.empty()) {
+		copy(tables_.back()->terms.get(), tables_.back()->terms.get() + term_count, table->terms.get());
+	}
+	for (size_t term_id = 0; term_id < term_count; ++term_id) {
+		Insert(*table, static_cast<TermId>(term_id));
+	}
+	// читатели, успевшие взять прежнюю таблицу, дочитают ее: она остается в tables_
+	table_.store(table.get(), memory_order_release);
+	tables_.push_back(move(table));
+}
+
+void TermDictionary::Insert(Table& table, TermId term_id) {
+	const size_t mask = table.capacity - 1;
+	size_t slot = hash<string_view>{}(table.terms[term_id]) & mask;
+	while (table.slots[slot].load(memory_order_relaxed) != NO_TERM) {
+		slot = (slot + 1) & mask;
+	}
+	table.slots[slot].store(term_id, memory_order_release);
+}
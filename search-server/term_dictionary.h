@@ -0,0 +1,86 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+using TermId = uint32_t;
+
+const TermId NO_TERM = std::numeric_limits<TermId>::max();
+
+// Арена для строк: память выделяется большими блоками, строки копируются в них подряд
+// и живут до уничтожения арены. Адреса сохраненных строк не меняются.
+class StringArena {
+public:
+	static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+	std::string_view Store(std::string_view text);
+
+	size_t GetAllocatedBytes() const {
+		return allocated_bytes_;
+	}
+
+private:
+	std::vector<std::unique_ptr<char[]>> blocks_;
+	char* free_begin_ = nullptr;
+	size_t free_size_ = 0;
+	size_t allocated_bytes_ = 0;
+};
+
+// Словарь слов: каждое различное слово хранится в арене один раз и получает 32-битный номер.
+// Номера выдаются подряд с нуля и не переиспользуются.
+// Слова добавляет один поток, искать и читать их другие потоки могут одновременно с ним:
+// таблица поиска растет заменой на новую, прежние таблицы живут до уничтожения словаря.
+class TermDictionary {
+public:
+	TermDictionary();
+
+	TermDictionary(const TermDictionary&) = delete;
+	TermDictionary& operator=(const TermDictionary&) = delete;
+
+	// номер слова; слово добавляется, если его еще нет
+	TermId Intern(std::string_view term);
+
+	// то же, но текст слова не копируется: он должен жить дольше словаря (например, в отображенном снимке)
+	TermId InternExternal(std::string_view term);
+
+	void Reserve(size_t term_count);
+
+	// NO_TERM, если слова нет в словаре
+	TermId Find(std::string_view term) const;
+
+	std::string_view GetTerm(TermId term_id) const {
+		return table_.load(std::memory_order_acquire)->terms[term_id];
+	}
+
+	size_t size() const {
+		return size_.load(std::memory_order_acquire);
+	}
+
+	size_t GetAllocatedBytes() const;
+
+private:
+	// открытая адресация; слот хранит номер слова или NO_TERM, заполнено не больше половины слотов
+	struct Table {
+		explicit Table(size_t capacity);
+
+		size_t capacity;
+		std::unique_ptr<std::atomic<TermId>[]> slots;
+		std::unique_ptr<std::string_view[]> terms; // по номеру, вмещает capacity / 2 слов
+	};
+
+	static const size_t INITIAL_CAPACITY = 16;
+
+	StringArena arena_;
+	std::vector<std::unique_ptr<Table>> tables_; // последняя - текущая
+	std::atomic<const Table*> table_ = nullptr;
+	std::atomic<size_t> size_ = 0;
+
+	TermId Add(std::string_view stored_term);
+
+	void Grow(size_t capacity);
+
+	static void Insert(Table& table, TermId term_id);
+};
@@ -0,0 +1,55 @@
+#pragma once
+#include <memory>
+
+// Рабочие буферы, которые живут в потоке и переиспользуются между вызовами, так что после первых
+// вызовов их память уже выделена. Если буферы потока заняты (вложенный вызов, например из задачи,
+// которую поток взял, пока ждал параллельный алгоритм), выдаются временные
+template <typename Scratch>
+class ScratchLease {
+public:
+	ScratchLease(const ScratchLease&) = delete;
+	ScratchLease& operator=(const ScratchLease&) = delete;
+
+	~ScratchLease() {
+		if (slot_) {
+			slot_->in_use = false;
+		}
+	}
+
+	static ScratchLease Acquire() {
+		thread_local Slot thread_slot;
+		if (!thread_slot.in_use) {
+			return ScratchLease(thread_slot);
+		}
+		return ScratchLease(std::make_unique<Scratch>());
+	}
+
+	Scratch& operator*() const {
+		return *scratch_;
+	}
+
+	Scratch* operator->() const {
+		return scratch_;
+	}
+
+private:
+	struct Slot {
+		Scratch scratch;
+		bool in_use = false;
+	};
+
+	Slot* slot_ = nullptr;
+	std::unique_ptr<Scratch> owned_;
+	Scratch* scratch_;
+
+	explicit ScratchLease(Slot& slot)
+		: slot_(&slot)
+		, scratch_(&slot.scratch) {
+		slot_->in_use = true;
+	}
+
+	explicit ScratchLease(std::unique_ptr<Scratch> owned)
+		: owned_(std::move(owned))
+		, scratch_(owned_.get()) {
+	}
+};